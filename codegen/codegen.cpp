@@ -1,7 +1,9 @@
 #include <iostream>
 #include <map>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <easypb.hpp>
 #include "descriptor.pb.cpp"
@@ -14,11 +16,19 @@ struct
     bool no_class = false;
     bool no_decoder = false;
     bool no_encoder = false;
+    bool no_sizer = false;
     bool no_has_fields = false;
     bool no_required = false;
     bool no_default_values = false;
     bool packed = false;
     bool no_packed = false;
+    bool table_decoder = false;
+    bool reserve_fields = false;
+    bool prescan_repeated = false;
+    bool reuse_storage = false;
+    bool arena = false;
+    bool lazy = false;
+    std::set<std::string> lazy_fields;  // fields decoded lazily, as "Message.field"
     std::string cpp_string_type;
     std::string cpp_repeated_type;
     std::string cpp_map_type;
@@ -63,9 +73,9 @@ EASYPB_{0}_EXTRA_FIELDS
 )---";
 
 
-// {0}=message_type.name, {1}=encoder
+// {0}=message_type.name, {1}=encoder, {2}=encoder class (Encoder or Sizer)
 const char* ENCODER_TEMPLATE = R"---(
-inline void encode(easypb::Encoder &pb, const {0} &x)
+inline void encode(easypb::{2} &pb, const {0} &x)
 {
 {1}
 #ifdef EASYPB_{0}_EXTRA_ENCODING
@@ -75,11 +85,12 @@ EASYPB_{0}_EXTRA_ENCODING(pb, x)
 )---";
 
 
-// {0}=message_type.name, {1}=decoder, {2}=check_required_fields
+// {0}=message_type.name, {1}=decoder, {2}=check_required_fields, {3}=prologue, {4}=epilogue
 const char* DECODER_TEMPLATE = R"---(
-inline void decode(easypb::Decoder pb, {0} &x)
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, {0} &x)
 {
-    while(pb.get_next_field())
+{3}    while(pb.get_next_field())
     {
         switch(pb.field_num)
         {
@@ -90,22 +101,69 @@ EASYPB_{0}_EXTRA_DECODING(pb, x)
             default: pb.skip_field();
         }
     }
-#ifdef EASYPB_{0}_EXTRA_POST_DECODING
+{4}#ifdef EASYPB_{0}_EXTRA_POST_DECODING
+EASYPB_{0}_EXTRA_POST_DECODING(pb, x)
+#endif
+{2}
+    return pb.status;
+}
+)---";
+
+
+// {0}=message_type.name, {1}=field_table, {2}=check_required_fields, {3}=prologue, {4}=epilogue,
+// {5}=decoder for the fields missing in the table
+const char* TABLE_DECODER_TEMPLATE = R"---(
+EASYPB_TABLE_DECODER_BEGIN
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, {0} &x)
+{
+    using Decoder = easypb::BasicDecoder<InputPolicy>;
+    static constexpr easypb::FieldEntry<Decoder> fields[] = {
+{1}    };
+{3}
+    while(pb.get_next_field(fields, &x))
+    {
+        switch(pb.field_num)
+        {
+{5}#ifdef EASYPB_{0}_EXTRA_DECODING
+EASYPB_{0}_EXTRA_DECODING(pb, x)
+#endif
+            default: pb.skip_field();
+        }
+    }
+{4}#ifdef EASYPB_{0}_EXTRA_POST_DECODING
 EASYPB_{0}_EXTRA_POST_DECODING(pb, x)
 #endif
 {2}
+    return pb.status;
 }
+EASYPB_TABLE_DECODER_END
 )---";
 
 
 // {0}=message_type.name, {1}=field.name
 const char* CHECK_REQUIRED_FIELD_TEMPLATE = R"---(
     if(! x.has_{1}) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field {0}.{1}");
+        return pb.missing_field("{0}.{1}");
     }
 )---";
 
 
+// {0}=reset_fields. A repeated occurrence of the message is merged into the first one, so it isn't reset
+const char* RESET_FIELDS_TEMPLATE = R"---(    if(! pb.merging)
+    {
+{0}    }
+)---";
+
+
+// {0}=repeated_tags, {1}=number of tags, {2}=reserve_repeated_fields
+const char* PRESCAN_TEMPLATE = R"---(    static constexpr uint32_t repeated_tags[] = {
+{0}    };
+    size_t repeated_counts[{1}];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+{2})---";
+
+
 
 // Is it a repeated Protobuf field?
 bool is_repeated(const FieldDescriptorProto& field)
@@ -120,6 +178,20 @@ bool hasfield_enabled(const FieldDescriptorProto& field)
     return (! is_repeated(field)  &&  ! option.no_has_fields);
 }
 
+// Is the presence of the required field checked after decoding?
+bool is_checked_required(const FieldDescriptorProto& field)
+{
+    return (field.label == FieldDescriptorProto::LABEL_REQUIRED  &&  ! option.no_required);
+}
+
+
+// Is it a message field decoded on the first access, i.e. easypb::Lazy<T>?
+bool is_lazy(const FieldDescriptorProto& field)
+{
+    return field.type == FieldDescriptorProto::TYPE_MESSAGE  &&
+           (option.lazy  ||  option.lazy_fields.count(msgtype_name_prefix + std::string(field.name)));
+}
+
 
 // Is it a Protobuf numeric field (including enums/bools)?
 bool is_numeric_field(const FieldDescriptorProto& field)
@@ -143,6 +215,7 @@ bool write_as_packed(const FieldDescriptorProto& field)
 }
 
 
+
 // Either " = default_field_value" or empty string
 std::string default_value_str(const FieldDescriptorProto& field)
 {
@@ -284,6 +357,9 @@ std::string protobuf_type_as_str(const FieldDescriptorProto& field, const MapTyp
 std::string cpp_type_as_str(const FieldDescriptorProto& field, const MapType* map_type)
 {
     auto basetype_str = base_cpp_type_as_str(field);
+    if (is_lazy(field)) {
+        basetype_str = "easypb::Lazy<" + basetype_str + ">";
+    }
 
     if (map_type) {
         return myformat(option.cpp_map_type,
@@ -299,16 +375,84 @@ std::string cpp_type_as_str(const FieldDescriptorProto& field, const MapType* ma
 }
 
 
-// Encoder code for a single field
-std::string generate_field_encoder(const FieldDescriptorProto& field, const MapType* map_type)
+// Encoder code for a single field. Unchecked put_* writes the field into the space reserved beforehand
+std::string generate_field_encoder(const FieldDescriptorProto& field, const MapType* map_type, bool unchecked = false)
 {
-    return myformat("    pb.put_{0}{1}({2}, {3});\n",
+    return myformat("    pb.put_{0}{1}{2}({3}, {4});\n",
     /* 0 */ ! map_type && is_repeated(field)
                 ? (write_as_packed(field)? "packed_" : "repeated_")
                 : "",
     /* 1 */ protobuf_type_as_str(field, map_type),
-    /* 2 */ std::to_string(field.number),
-    /* 3 */ "x." + std::string(field.name));
+    /* 2 */ unchecked? "_unchecked" : "",
+    /* 3 */ "easypb::FieldNum<" + std::to_string(field.number) + ">()",
+    /* 4 */ "x." + std::string(field.name));
+}
+
+
+// Maximum encoded size of the field including its tag, or 0 if it isn't a single fixed-size value
+size_t max_encoded_size(const FieldDescriptorProto& field)
+{
+    if (is_repeated(field)  ||  ! is_numeric_field(field))  return 0;
+
+    size_t tag_size = easypb::varint_size(easypb::field_tag(field.number, easypb::WIRETYPE_VARINT));
+    switch(field.type)
+    {
+        case FieldDescriptorProto::TYPE_BOOL:      return tag_size + 1;
+        case FieldDescriptorProto::TYPE_FIXED32:
+        case FieldDescriptorProto::TYPE_SFIXED32:
+        case FieldDescriptorProto::TYPE_FLOAT:     return tag_size + 4;
+        case FieldDescriptorProto::TYPE_FIXED64:
+        case FieldDescriptorProto::TYPE_SFIXED64:
+        case FieldDescriptorProto::TYPE_DOUBLE:    return tag_size + 8;
+        case FieldDescriptorProto::TYPE_UINT32:
+        case FieldDescriptorProto::TYPE_SINT32:    return tag_size + 5;
+        default:                                   return tag_size + easypb::MAX_VARINT_SIZE;  // negative int32/enum take 10 bytes too
+    }
+}
+
+
+// Encoder code for a run of consecutive fixed-size fields.
+// With --reserve-fields, space for two or more fields is reserved at once, and they are written without bound checks
+std::string generate_fields_run(std::vector<const FieldDescriptorProto*>& fields, size_t max_size)
+{
+    std::string code;
+    bool fused = (fields.size() >= 2);
+    if (fused) {
+        code += myformat("    pb.reserve_fields({});\n", std::to_string(max_size));
+    }
+    for (auto field: fields) {
+        code += generate_field_encoder(*field, nullptr, fused);
+    }
+    if (fused) {
+        code += "    pb.commit_fields();\n";
+    }
+
+    fields.clear();
+    return code;
+}
+
+
+// Are the field elements decoded over the existing ones in the --reuse-storage mode?
+// Lazy messages aren't, since they may keep the encoded message from the previous input
+bool reuses_elements(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    return option.reuse_storage  &&  ! map_type  &&  is_repeated(field)  &&  ! is_numeric_field(field)  &&  ! is_lazy(field);
+}
+
+
+// Is it a non-repeated message field decoded over the existing message in the --reuse-storage mode?
+bool is_singular_message(const FieldDescriptorProto& field)
+{
+    return ! is_repeated(field)  &&  field.type == FieldDescriptorProto::TYPE_MESSAGE  &&  ! is_lazy(field);
+}
+
+
+// Is the field decoded with a local variable, e.g. the element count, that the decoding table can't pass?
+// Submessages also need to know whether they were already seen, to merge the next occurrence into the first one
+bool uses_local_state(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    return reuses_elements(field, map_type)  ||
+           (option.reuse_storage  &&  is_singular_message(field));
 }
 
 
@@ -320,12 +464,158 @@ std::string generate_field_decoder(const FieldDescriptorProto& field, const MapT
     /* 1 */ ! map_type && is_repeated(field)? "repeated_" : "",
     /* 2 */ protobuf_type_as_str(field, map_type),
     /* 3 */ "x." + std::string(field.name),
-    /* 4 */ hasfield_enabled(field)
+    /* 4 */ reuses_elements(field, map_type)
+                ? myformat(", &{0}_count", field.name)
+            : hasfield_enabled(field)
                 ? myformat(", &x.has_{0}", field.name)
+            : option.reuse_storage  &&  is_singular_message(field)
+                ? myformat(", &{0}_found", field.name)
                 : "");
 }
 
 
+// Local variables of the --reuse-storage decoder. When merging a repeated occurrence of the message,
+// repeated elements are appended after the existing ones, and submessages are merged into the existing ones
+std::string generate_field_locals(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    if (reuses_elements(field, map_type)) {
+        return myformat("    size_t {0}_count = (pb.merging? x.{0}.size() : 0);\n", field.name);
+    }
+    if (is_singular_message(field)  &&  ! hasfield_enabled(field)) {
+        return myformat("    bool {0}_found = pb.merging;\n", field.name);
+    }
+    return "";
+}
+
+
+// Code resetting the field prior to decoding in the --reuse-storage mode, keeping its storage for reuse.
+// Repeated messages and strings are decoded over the existing elements, counting them.
+// Submessages are decoded over the existing ones too, so they are reset afterwards only if missing
+std::string generate_field_reset(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    if (reuses_elements(field, map_type)) {
+        return "";
+    }
+    if (is_repeated(field)) {
+        return myformat("        easypb::clear_value(x.{0});\n", field.name);
+    }
+
+    std::string reset_has_field = hasfield_enabled(field)? myformat("        x.has_{0} = false;\n", field.name) : "";
+    if (is_singular_message(field)) {
+        return reset_has_field;
+    }
+    std::string default_value = default_value_str(field);
+    return (default_value.empty()? myformat("        easypb::clear_value(x.{0});\n", field.name)
+                                 : myformat("        x.{0}{1};\n", field.name, default_value))
+           + reset_has_field;
+}
+
+
+// Code finishing the decoding in the --reuse-storage mode: erase extra elements and reset missing submessages.
+// A missing required submessage is left as is, since the decoding fails anyway
+std::string generate_field_cleanup(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    if (reuses_elements(field, map_type)) {
+        return myformat("    easypb::truncate(x.{0}, {0}_count);\n", field.name);
+    }
+    if (is_singular_message(field)  &&  ! is_checked_required(field)) {
+        return myformat("    if(! {1})  easypb::clear_value(x.{0});\n",
+                        field.name,
+                        hasfield_enabled(field)? "x.has_" + std::string(field.name) : std::string(field.name) + "_found");
+    }
+    return "";
+}
+
+
+// Wire type of a single field value, i.e. the unpacked form of repeated numeric fields
+const char* value_wiretype_name(const FieldDescriptorProto& field)
+{
+    switch(field.type)
+    {
+        case FieldDescriptorProto::TYPE_FIXED32:
+        case FieldDescriptorProto::TYPE_SFIXED32:
+        case FieldDescriptorProto::TYPE_FLOAT:     return "WIRETYPE_FIXED32";
+
+        case FieldDescriptorProto::TYPE_FIXED64:
+        case FieldDescriptorProto::TYPE_SFIXED64:
+        case FieldDescriptorProto::TYPE_DOUBLE:    return "WIRETYPE_FIXED64";
+
+        case FieldDescriptorProto::TYPE_STRING:
+        case FieldDescriptorProto::TYPE_BYTES:
+        case FieldDescriptorProto::TYPE_MESSAGE:
+        case FieldDescriptorProto::TYPE_GROUP:     return "WIRETYPE_LENGTH_DELIMITED";
+
+        default:                                   return "WIRETYPE_VARINT";
+    }
+}
+
+
+// Wire type used by our Encoder for the field
+const char* wiretype_name(const FieldDescriptorProto& field)
+{
+    if (write_as_packed(field))  return "WIRETYPE_LENGTH_DELIMITED";
+    return value_wiretype_name(field);
+}
+
+
+// FieldKind of the field in the table-driven decoder
+const char* field_kind_name(const FieldDescriptorProto& field, const MapType* map_type)
+{
+    if (map_type || is_repeated(field))  return "FIELD_CUSTOM";
+
+    switch(field.type)
+    {
+        case FieldDescriptorProto::TYPE_INT32:
+        case FieldDescriptorProto::TYPE_UINT32:
+        case FieldDescriptorProto::TYPE_ENUM:      return "FIELD_VARINT32";
+
+        case FieldDescriptorProto::TYPE_INT64:
+        case FieldDescriptorProto::TYPE_UINT64:    return "FIELD_VARINT64";
+
+        case FieldDescriptorProto::TYPE_SINT32:    return "FIELD_SINT32";
+        case FieldDescriptorProto::TYPE_SINT64:    return "FIELD_SINT64";
+        case FieldDescriptorProto::TYPE_BOOL:      return "FIELD_BOOL";
+
+        case FieldDescriptorProto::TYPE_FIXED32:
+        case FieldDescriptorProto::TYPE_SFIXED32:  return "FIELD_FIXED32";
+
+        case FieldDescriptorProto::TYPE_FIXED64:
+        case FieldDescriptorProto::TYPE_SFIXED64:  return "FIELD_FIXED64";
+
+        case FieldDescriptorProto::TYPE_FLOAT:     return "FIELD_FLOAT";
+        case FieldDescriptorProto::TYPE_DOUBLE:    return "FIELD_DOUBLE";
+
+        case FieldDescriptorProto::TYPE_STRING:
+        case FieldDescriptorProto::TYPE_BYTES:
+            return option.cpp_string_type == "std::string" ? "FIELD_STRING" : "FIELD_CUSTOM";
+
+        default:                                   return "FIELD_CUSTOM";
+    }
+}
+
+
+// Entry of the field table for a single field
+std::string generate_field_entry(str_view message_name, const FieldDescriptorProto& field, const MapType* map_type)
+{
+    std::string kind = field_kind_name(field, map_type);
+    return myformat("        {easypb::field_tag({0}, easypb::{1}), easypb::{2}, offsetof({3}, {4}), {5}, {6}},\n",
+    /* 0 */ std::to_string(field.number),
+    /* 1 */ wiretype_name(field),
+    /* 2 */ kind,
+    /* 3 */ message_name,
+    /* 4 */ field.name,
+    /* 5 */ hasfield_enabled(field)
+                ? myformat("offsetof({0}, has_{1})", message_name, field.name)
+                : "easypb::NO_HAS_FIELD",
+    /* 6 */ kind == "FIELD_CUSTOM"
+                ? myformat("&Decoder::template table_get_{0}{1}<{2}>",
+                           ! map_type && is_repeated(field)? "repeated_" : "",
+                           protobuf_type_as_str(field, map_type),
+                           cpp_type_as_str(field, map_type))
+                : "nullptr");
+}
+
+
 // Collect map types represented as the nested message types
 MapTypeByName collect_map_types(const DescriptorProto& message_type)
 {
@@ -406,7 +696,11 @@ void generator(const FileDescriptorProto& file)
 
     for (const auto& message_type: file.message_type)
     {
-        std::string field_defs, has_field_defs, encoder, decoder, check_required_fields;
+        std::string field_defs, has_field_defs, encoder, decoder, field_table, check_required_fields;
+        std::string repeated_tags, reserve_repeated_fields, reuse_locals, reset_fields, cleanup_fields, attach_fields, table_decoder;
+        size_t repeated_fields = 0;
+        std::vector<const FieldDescriptorProto*> fields_run;  // fixed-size fields encoded with a single reservation
+        size_t fields_run_size = 0;
         msgtype_name_prefix = std::string(message_type.name) + PB_TYPE_DELIMITER;
 
         auto map_types = collect_map_types(message_type);
@@ -424,24 +718,74 @@ void generator(const FileDescriptorProto& file)
             }
 
             // Generate message encoding function
-            encoder += generate_field_encoder(field, map_type);
+            size_t max_size = (option.reserve_fields? max_encoded_size(field) : 0);
+            if (max_size) {
+                fields_run.push_back(&field);
+                fields_run_size += max_size;
+            } else {
+                encoder += generate_fields_run(fields_run, fields_run_size);
+                encoder += generate_field_encoder(field, map_type);
+                fields_run_size = 0;
+            }
 
             // Generate message decoding function
             decoder += generate_field_decoder(field, map_type);
+            if (uses_local_state(field, map_type)) {
+                table_decoder += generate_field_decoder(field, map_type);
+            } else {
+                field_table += generate_field_entry(message_type.name, field, map_type);
+            }
+            if (option.reuse_storage) {
+                reuse_locals += generate_field_locals(field, map_type);
+                reset_fields += generate_field_reset(field, map_type);
+                cleanup_fields += generate_field_cleanup(field, map_type);
+            }
 
-            if ((field.label == FieldDescriptorProto::LABEL_REQUIRED)  &&  ! option.no_required) {
+            if (option.arena  &&  is_repeated(field)  &&  ! map_type) {
+                attach_fields += myformat("    easypb::attach_arena(x.{}, pb.arena);\n", field.name);
+            }
+
+            // Maps are counted too, to reserve the buckets of hash tables
+            if (option.prescan_repeated  &&  is_repeated(field)) {
+                repeated_tags += myformat("        easypb::field_tag({0}, easypb::{1}),\n",
+                                          std::to_string(field.number), value_wiretype_name(field));
+                // With --reuse-storage, repeated fields are decoded over the existing elements from {0}_count on
+                reserve_repeated_fields += myformat(reuses_elements(field, map_type)
+                                                        ? "    easypb::reserve_space(x.{0}, {0}_count + repeated_counts[{1}]);\n"
+                                                        : "    easypb::reserve_space(x.{0}, x.{0}.size() + repeated_counts[{1}]);\n",
+                                                    field.name, std::to_string(repeated_fields++));
+            }
+
+            if (is_checked_required(field)) {
                 check_required_fields += myformat(CHECK_REQUIRED_FIELD_TEMPLATE, message_type.name, field.name);
             }
         }
 
+        encoder += generate_fields_run(fields_run, fields_run_size);
+        std::string prologue = reuse_locals;
+        if (! reset_fields.empty()) {
+            prologue += myformat(RESET_FIELDS_TEMPLATE, reset_fields);
+        }
+        prologue += attach_fields;
+        if (repeated_fields) {
+            prologue += myformat(PRESCAN_TEMPLATE, repeated_tags, std::to_string(repeated_fields), reserve_repeated_fields);
+        }
+
         if (! option.no_class) {
             std::cout << myformat(CLASS_TEMPLATE, message_type.name, field_defs, has_field_defs);
         }
         if (! option.no_encoder) {
-            std::cout << myformat(ENCODER_TEMPLATE, message_type.name, encoder);
+            std::cout << myformat(ENCODER_TEMPLATE, message_type.name, encoder, "Encoder");
+        }
+        if (! option.no_encoder  &&  ! option.no_sizer) {
+            std::cout << myformat(ENCODER_TEMPLATE, message_type.name, encoder, "Sizer");
         }
-        if (! option.no_decoder) {
-            std::cout << myformat(DECODER_TEMPLATE, message_type.name, decoder, check_required_fields);
+        if (! option.no_decoder  &&  option.table_decoder  &&  ! field_table.empty()) {
+            std::cout << myformat(TABLE_DECODER_TEMPLATE, message_type.name, field_table, check_required_fields,
+                                  prologue, cleanup_fields, table_decoder);
+        } else if (! option.no_decoder) {
+            std::cout << myformat(DECODER_TEMPLATE, message_type.name, decoder, check_required_fields,
+                                  prologue, cleanup_fields);
         }
     }
 }
@@ -151,7 +151,7 @@ struct FileDescriptorSet
 };
 
 
-inline void decode(easypb::Decoder pb, OneofDescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, OneofDescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -161,10 +161,12 @@ inline void decode(easypb::Decoder pb, OneofDescriptorProto &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, EnumValueDescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, EnumValueDescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -175,10 +177,12 @@ inline void decode(easypb::Decoder pb, EnumValueDescriptorProto &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, EnumDescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, EnumDescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -189,10 +193,12 @@ inline void decode(easypb::Decoder pb, EnumDescriptorProto &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, FieldOptions &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, FieldOptions &x)
 {
     while(pb.get_next_field())
     {
@@ -202,10 +208,12 @@ inline void decode(easypb::Decoder pb, FieldOptions &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, FieldDescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, FieldDescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -224,12 +232,14 @@ inline void decode(easypb::Decoder pb, FieldDescriptorProto &x)
     }
 
     if(! x.has_name) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field FieldDescriptorProto.name");
+        return pb.missing_field("FieldDescriptorProto.name");
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, MessageOptions &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, MessageOptions &x)
 {
     while(pb.get_next_field())
     {
@@ -239,10 +249,12 @@ inline void decode(easypb::Decoder pb, MessageOptions &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, DescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, DescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -259,12 +271,14 @@ inline void decode(easypb::Decoder pb, DescriptorProto &x)
     }
 
     if(! x.has_name) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field DescriptorProto.name");
+        return pb.missing_field("DescriptorProto.name");
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, FileDescriptorProto &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, FileDescriptorProto &x)
 {
     while(pb.get_next_field())
     {
@@ -278,10 +292,12 @@ inline void decode(easypb::Decoder pb, FileDescriptorProto &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 
-inline void decode(easypb::Decoder pb, FileDescriptorSet &x)
+inline easypb::DecodeStatus decode(easypb::Decoder pb, FileDescriptorSet &x)
 {
     while(pb.get_next_field())
     {
@@ -291,6 +307,8 @@ inline void decode(easypb::Decoder pb, FileDescriptorSet &x)
             default: pb.skip_field();
         }
     }
+
+    return pb.status;
 }
 
 #endif
@@ -188,6 +188,8 @@ CommandLine parse_cmdline(int argc, char** argv)
         "d", "no-decoder", "don't generate decoder", &option.no_decoder);
     auto no_encoder_option = parser.add<Switch>(
         "e", "no-encoder", "don't generate encoder", &option.no_encoder);
+    auto no_sizer_option = parser.add<Switch>(
+        "", "no-sizer", "don't generate encoded-size computation", &option.no_sizer);
     auto no_has_option = parser.add<Switch>(
         "f", "no-has-fields", "don't generate has_* fields", &option.no_has_fields);
     auto no_required_option = parser.add<Switch>(
@@ -198,6 +200,20 @@ CommandLine parse_cmdline(int argc, char** argv)
         "p", "packed", "make all repeated fields packed when allowed", &option.packed);
     auto no_packed_option = parser.add<Switch>(
         "", "no-packed", "make all repeated fields non-packed", &option.no_packed);
+    auto table_decoder_option = parser.add<Switch>(
+        "t", "table-decoder", "generate table-driven decoders", &option.table_decoder);
+    auto reserve_fields_option = parser.add<Switch>(
+        "", "reserve-fields", "reserve space for consecutive fixed-size fields at once", &option.reserve_fields);
+    auto prescan_repeated_option = parser.add<Switch>(
+        "", "prescan-repeated", "count repeated fields to reserve space prior to decoding", &option.prescan_repeated);
+    auto reuse_storage_option = parser.add<Switch>(
+        "", "reuse-storage", "decode over the existing fields and elements, reusing their storage", &option.reuse_storage);
+    auto arena_option = parser.add<Switch>(
+        "", "arena", "allocate repeated fields and strings of decoded messages from easypb::Arena", &option.arena);
+    auto lazy_option = parser.add<Switch>(
+        "", "lazy", "decode all message fields on the first access", &option.lazy);
+    auto lazy_field_option = parser.add<Value<std::string> >(
+        "", "lazy-field", "decode the message field on the first access, e.g. Message.field (may be repeated)");
 
     auto string_type_option = parser.add<Value<std::string> >(
         "s", "string-type", "C++ type for string/bytes fields",
@@ -261,9 +277,13 @@ CommandLine parse_cmdline(int argc, char** argv)
 
     const bool generation_option_set =
         no_class_option->is_set() || no_decoder_option->is_set() ||
-        no_encoder_option->is_set() || no_has_option->is_set() ||
+        no_encoder_option->is_set() || no_sizer_option->is_set() ||
+        no_has_option->is_set() ||
         no_required_option->is_set() || no_defaults_option->is_set() ||
         packed_option->is_set() || no_packed_option->is_set() ||
+        table_decoder_option->is_set() || reserve_fields_option->is_set() ||
+        prescan_repeated_option->is_set() || reuse_storage_option->is_set() ||
+        arena_option->is_set() || lazy_option->is_set() || lazy_field_option->is_set() ||
         string_type_option->is_set() || repeated_type_option->is_set() ||
         map_type_option->is_set();
     if (command.action != ACTION_GENERATE && generation_option_set) {
@@ -275,6 +295,14 @@ CommandLine parse_cmdline(int argc, char** argv)
     if (option.no_has_fields) {
         option.no_required = true;  // we can't check presence of a required field without employing the corresponding has_* field
     }
+    for (size_t i = 0; i < lazy_field_option->count(); i++) {
+        option.lazy_fields.insert(lazy_field_option->value(i));
+    }
+    if (option.arena) {
+        // Arena-allocated types, unless the user asked for other ones
+        if (! string_type_option->is_set())    option.cpp_string_type = "easypb::string_view";
+        if (! repeated_type_option->is_set())  option.cpp_repeated_type = "easypb::ArenaVector";
+    }
     if (option.cpp_repeated_type.find("{}") == std::string::npos &&
         option.cpp_repeated_type.find("{0}") == std::string::npos) {
         option.cpp_repeated_type += "<{}>";
@@ -0,0 +1,111 @@
+// Shared parts of the benchmarks: synthetic corpus and timing
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.pb.cpp"
+#if __cplusplus >= 201703L
+#include "../filetree/filetree.pb.hpp"
+#endif
+
+
+// Fill the record with pseudo-random data of the size typical for log/event records
+inline Record make_record(std::mt19937_64& rng)
+{
+    auto random = [&](uint64_t limit) {return rng() % limit;};
+    Record record;
+
+    record.id       = rng();
+    record.name     = "record-" + std::to_string(random(1000000));
+    record.score    = random(1000000) / 1000.0;
+    record.checksum = uint32_t(rng());
+    record.origin.x = int32_t(random(2000)) - 1000;
+    record.origin.y = int32_t(random(2000)) - 1000;
+
+    for (int i = random(16);  i > 0;  i--) {
+        record.values.push_back(int64_t(rng() >> random(64)));
+        record.deltas.push_back(int32_t(random(200)) - 100);
+        record.weights.push_back(random(1000) / 10.0);
+    }
+    for (int i = random(4);  i > 0;  i--) {
+        record.tags.push_back("tag" + std::to_string(random(100)));
+    }
+    for (int i = random(8);  i > 0;  i--) {
+        Point point;
+        point.x = int32_t(random(1u << 20)) - (1 << 19);
+        point.y = int32_t(random(1u << 20)) - (1 << 19);
+        record.points.push_back(point);
+    }
+    for (int i = random(4);  i > 0;  i--) {
+        record.counters["counter" + std::to_string(i)] = int32_t(random(100000));
+    }
+    return record;
+}
+
+// Record stream of `count` records, generated with a fixed seed
+inline std::string make_corpus(size_t count)
+{
+    std::mt19937_64 rng(42);
+    easypb::RecordWriter writer;
+    for (size_t i = 0; i < count; i++) {
+        writer.write(make_record(rng));
+    }
+    return writer.pb.result();
+}
+
+#if __cplusplus >= 201703L
+// Directory tree of `dirs` directories with `files` regular files each; the names are kept in `names`
+inline filetree::FileTree make_file_tree(size_t dirs, size_t files, std::vector<std::string>& names)
+{
+    names.reserve(dirs * (files+1));
+    filetree::FileTree tree;
+    tree.root.name = ".";
+    tree.root.kind = filetree::directory;
+    for (size_t d = 0; d < dirs; d++) {
+        names.push_back("directory-" + std::to_string(d));
+        filetree::Node dir;
+        dir.name = names.back();
+        dir.kind = filetree::directory;
+        dir.last_write_time_unix_ns = 1700000000000000000 + d;
+        dir.permissions = 0755;
+        dir.has_last_write_time_unix_ns = dir.has_permissions = true;
+        for (size_t f = 0; f < files; f++) {
+            names.push_back("file-" + std::to_string(f) + ".txt");
+            filetree::Node file;
+            file.name = names.back();
+            file.kind = filetree::regular_file;
+            file.size = d * files + f;
+            file.last_write_time_unix_ns = 1700000000000000000 + f;
+            file.permissions = 0644;
+            file.has_size = file.has_last_write_time_unix_ns = file.has_permissions = true;
+            dir.children.push_back(file);
+        }
+        tree.root.children.push_back(std::move(dir));
+    }
+    return tree;
+}
+#endif
+
+// The best time of `repeat` runs, in seconds
+template <typename Operation>
+double best_time(int repeat, Operation operation)
+{
+    double best = 1e100;
+    for (int i = 0; i < repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        operation();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)  best = elapsed.count();
+    }
+    return best;
+}
+
+inline double mib_per_sec(size_t bytes, double seconds)
+{
+    return bytes / seconds / (1024*1024);
+}
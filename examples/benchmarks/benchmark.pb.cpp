@@ -0,0 +1,161 @@
+// Generated by EasyProtoBuf Codegen.  DO NOT EDIT!
+// Source: benchmark.proto
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <easypb.hpp>
+
+
+struct Point
+{
+    int32_t x = 0;
+    int32_t y = 0;
+
+    bool has_x = false;
+    bool has_y = false;
+
+#ifdef EASYPB_Point_EXTRA_FIELDS
+EASYPB_Point_EXTRA_FIELDS
+#endif
+};
+
+inline void encode(easypb::Encoder &pb, const Point &x)
+{
+    pb.put_sint32(easypb::FieldNum<1>(), x.x);
+    pb.put_sint32(easypb::FieldNum<2>(), x.y);
+
+#ifdef EASYPB_Point_EXTRA_ENCODING
+EASYPB_Point_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+inline void encode(easypb::Sizer &pb, const Point &x)
+{
+    pb.put_sint32(easypb::FieldNum<1>(), x.x);
+    pb.put_sint32(easypb::FieldNum<2>(), x.y);
+
+#ifdef EASYPB_Point_EXTRA_ENCODING
+EASYPB_Point_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, Point &x)
+{
+    while(pb.get_next_field())
+    {
+        switch(pb.field_num)
+        {
+            case 1: pb.get_sint32(&x.x, &x.has_x); break;
+            case 2: pb.get_sint32(&x.y, &x.has_y); break;
+
+#ifdef EASYPB_Point_EXTRA_DECODING
+EASYPB_Point_EXTRA_DECODING(pb, x)
+#endif
+            default: pb.skip_field();
+        }
+    }
+#ifdef EASYPB_Point_EXTRA_POST_DECODING
+EASYPB_Point_EXTRA_POST_DECODING(pb, x)
+#endif
+
+    return pb.status;
+}
+
+struct Record
+{
+    uint64_t id = 0;
+    std::string name;
+    double score = 0;
+    uint32_t checksum = 0;
+    Point origin;
+    std::vector<int64_t> values;
+    std::vector<int32_t> deltas;
+    std::vector<double> weights;
+    std::vector<std::string> tags;
+    std::vector<Point> points;
+    std::map<std::string,int32_t> counters;
+
+    bool has_id = false;
+    bool has_name = false;
+    bool has_score = false;
+    bool has_checksum = false;
+    bool has_origin = false;
+
+#ifdef EASYPB_Record_EXTRA_FIELDS
+EASYPB_Record_EXTRA_FIELDS
+#endif
+};
+
+inline void encode(easypb::Encoder &pb, const Record &x)
+{
+    pb.put_uint64(easypb::FieldNum<1>(), x.id);
+    pb.put_string(easypb::FieldNum<2>(), x.name);
+    pb.put_double(easypb::FieldNum<3>(), x.score);
+    pb.put_fixed32(easypb::FieldNum<4>(), x.checksum);
+    pb.put_message(easypb::FieldNum<5>(), x.origin);
+    pb.put_packed_int64(easypb::FieldNum<11>(), x.values);
+    pb.put_packed_sint32(easypb::FieldNum<12>(), x.deltas);
+    pb.put_packed_double(easypb::FieldNum<13>(), x.weights);
+    pb.put_repeated_string(easypb::FieldNum<14>(), x.tags);
+    pb.put_repeated_message(easypb::FieldNum<15>(), x.points);
+    pb.put_map_string_int32(easypb::FieldNum<16>(), x.counters);
+
+#ifdef EASYPB_Record_EXTRA_ENCODING
+EASYPB_Record_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+inline void encode(easypb::Sizer &pb, const Record &x)
+{
+    pb.put_uint64(easypb::FieldNum<1>(), x.id);
+    pb.put_string(easypb::FieldNum<2>(), x.name);
+    pb.put_double(easypb::FieldNum<3>(), x.score);
+    pb.put_fixed32(easypb::FieldNum<4>(), x.checksum);
+    pb.put_message(easypb::FieldNum<5>(), x.origin);
+    pb.put_packed_int64(easypb::FieldNum<11>(), x.values);
+    pb.put_packed_sint32(easypb::FieldNum<12>(), x.deltas);
+    pb.put_packed_double(easypb::FieldNum<13>(), x.weights);
+    pb.put_repeated_string(easypb::FieldNum<14>(), x.tags);
+    pb.put_repeated_message(easypb::FieldNum<15>(), x.points);
+    pb.put_map_string_int32(easypb::FieldNum<16>(), x.counters);
+
+#ifdef EASYPB_Record_EXTRA_ENCODING
+EASYPB_Record_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, Record &x)
+{
+    while(pb.get_next_field())
+    {
+        switch(pb.field_num)
+        {
+            case 1: pb.get_uint64(&x.id, &x.has_id); break;
+            case 2: pb.get_string(&x.name, &x.has_name); break;
+            case 3: pb.get_double(&x.score, &x.has_score); break;
+            case 4: pb.get_fixed32(&x.checksum, &x.has_checksum); break;
+            case 5: pb.get_message(&x.origin, &x.has_origin); break;
+            case 11: pb.get_repeated_int64(&x.values); break;
+            case 12: pb.get_repeated_sint32(&x.deltas); break;
+            case 13: pb.get_repeated_double(&x.weights); break;
+            case 14: pb.get_repeated_string(&x.tags); break;
+            case 15: pb.get_repeated_message(&x.points); break;
+            case 16: pb.get_map_string_int32(&x.counters); break;
+
+#ifdef EASYPB_Record_EXTRA_DECODING
+EASYPB_Record_EXTRA_DECODING(pb, x)
+#endif
+            default: pb.skip_field();
+        }
+    }
+#ifdef EASYPB_Record_EXTRA_POST_DECODING
+EASYPB_Record_EXTRA_POST_DECODING(pb, x)
+#endif
+
+    return pb.status;
+}
@@ -0,0 +1,419 @@
+// Decoding speed of messages with many repeated submessages: synthetic file trees (requires C++17)
+// of various shapes, from a few large directories to many small ones, decoded into a new tree,
+// over the existing one, into an arena and with lazily decoded children; and of large map<string,string> and map<fixed64,string> fields
+//   Usage: decode [repeat]
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.hpp"
+
+
+// Message with a single map field: map<string,string> or map<fixed64,string> entries = 1;
+// decoded in the form generated by codegen --prescan-repeated
+template <typename MapType>
+struct MapMessage
+{
+    MapType entries;
+};
+
+template <typename MapType>
+void encode(easypb::Encoder& pb, const MapMessage<MapType>& x)
+{
+    pb.put_map_string_string(easypb::FieldNum<1>(), x.entries);
+}
+
+template <typename MapType>
+easypb::DecodeStatus decode(easypb::Decoder pb, MapMessage<MapType>& x)
+{
+    static constexpr uint32_t repeated_tags[] = {
+        easypb::field_tag(1, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.entries, x.entries.size() + repeated_counts[0]);
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_map_string_string(&x.entries); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+template <typename MapType>
+struct IdMapMessage
+{
+    MapType entries;
+};
+
+template <typename MapType>
+void encode(easypb::Encoder& pb, const IdMapMessage<MapType>& x)
+{
+    pb.put_map_fixed64_string(easypb::FieldNum<1>(), x.entries);
+}
+
+template <typename MapType>
+easypb::DecodeStatus decode(easypb::Decoder pb, IdMapMessage<MapType>& x)
+{
+    static constexpr uint32_t repeated_tags[] = {
+        easypb::field_tag(1, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.entries, x.entries.size() + repeated_counts[0]);
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_map_fixed64_string(&x.entries); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+// Map key made of the random id
+inline void assign_key(std::string& key, uint64_t id)  {key = "key-" + std::to_string(id);}
+inline void assign_key(uint64_t& key, uint64_t id)     {key = id;}
+
+// Decode the message with `count` map entries having 32-byte values, and print the speed
+template <typename MessageType>
+void run_map(const char* name, size_t count, int repeat)
+{
+    std::mt19937_64 rng(42);
+    MessageType msg;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t id = rng();
+        typename decltype(msg.entries)::key_type key;
+        assign_key(key, id);
+        std::string value = "value-" + std::to_string(id) + std::string(32, '.');
+        value.resize(32);
+        msg.entries[key] = value;
+    }
+    std::string buffer = easypb::encode(msg);
+
+    double time = best_time(repeat, [&] {
+        auto decoded = easypb::decode<MessageType>(buffer);
+    });
+    std::printf("%-32s %10.2f MiB/s %8.2f ns/entry\n", name, mib_per_sec(buffer.size(), time), time * 1e9 / count);
+}
+
+
+#if __cplusplus >= 201703L
+// File tree messages allocated from easypb::Arena, as generated by codegen --arena --prescan-repeated
+namespace arena_tree
+{
+
+struct Node
+{
+    easypb::string_view name;
+    uint32_t kind = 0;
+    uint64_t size = 0;
+    int64_t last_write_time_unix_ns = 0;
+    uint32_t permissions = 0;
+    easypb::string_view symlink_target;
+    easypb::ArenaVector<Node> children;
+};
+
+easypb::DecodeStatus decode(easypb::Decoder pb, Node& x)
+{
+    easypb::attach_arena(x.children, pb.arena);
+    static constexpr uint32_t repeated_tags[] = {
+        easypb::field_tag(7, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.children, x.children.size() + repeated_counts[0]);
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_string(&x.name); break;
+            case 2: pb.get_fixed32(&x.kind); break;
+            case 3: pb.get_fixed64(&x.size); break;
+            case 4: pb.get_sfixed64(&x.last_write_time_unix_ns); break;
+            case 5: pb.get_fixed32(&x.permissions); break;
+            case 6: pb.get_string(&x.symlink_target); break;
+            case 7: pb.get_repeated_message(&x.children); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+struct FileTree
+{
+    Node root;
+};
+
+easypb::DecodeStatus decode(easypb::Decoder pb, FileTree& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_message(&x.root); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+} // namespace arena_tree
+
+// Size of the names stored in the arena
+size_t count_name_bytes(const arena_tree::Node& node)
+{
+    size_t bytes = node.name.size() + node.symlink_target.size();
+    for (const arena_tree::Node& child: node.children) {
+        bytes += count_name_bytes(child);
+    }
+    return bytes;
+}
+
+// Heap memory held by the vectors of children: the bytes and the number of allocations
+void count_heap_memory(const filetree::Node& node, size_t& bytes, size_t& allocations)
+{
+    if (node.children.capacity()) {
+        bytes += node.children.capacity() * sizeof(filetree::Node);
+        allocations++;
+    }
+    for (const filetree::Node& child: node.children) {
+        count_heap_memory(child, bytes, allocations);
+    }
+}
+
+// Decode the file tree of `dirs` directories with `files` files each, both into a new tree
+// and over the same tree reused between the runs, and print the speed
+void run(size_t dirs, size_t files, int repeat)
+{
+    std::vector<std::string> names;
+    std::string buffer = easypb::encode(make_file_tree(dirs, files, names));
+
+    double time = best_time(repeat, [&] {
+        auto tree = easypb::decode<filetree::FileTree>(buffer);
+    });
+    filetree::FileTree tree;
+    double reused_time = best_time(repeat, [&] {
+        easypb::decode(buffer, &tree);
+    });
+    size_t nodes = dirs * (files+1);
+    std::printf("%6zu x %-6zu %10.2f MiB/s %8.2f ns/node %10.2f MiB/s %8.2f ns/node\n", dirs, files,
+                mib_per_sec(buffer.size(), time), time * 1e9 / nodes,
+                mib_per_sec(buffer.size(), reused_time), reused_time * 1e9 / nodes);
+}
+
+// Decode the file tree into a new arena each time, and into the same arena reset between the runs
+void run_arena(size_t dirs, size_t files, int repeat)
+{
+    std::vector<std::string> names;
+    std::string buffer = easypb::encode(make_file_tree(dirs, files, names));
+
+    double time = best_time(repeat, [&] {
+        easypb::Arena arena;
+        arena_tree::FileTree tree;
+        easypb::decode(buffer, &tree, arena);
+    });
+    easypb::Arena arena;
+    double reused_time = best_time(repeat, [&] {
+        {
+            arena_tree::FileTree tree;
+            easypb::decode(buffer, &tree, arena);
+        }
+        arena.reset();
+    });
+
+    size_t nodes = dirs * (files+1);
+    std::printf("%6zu x %-6zu %10.2f MiB/s %8.2f ns/node %10.2f MiB/s %8.2f ns/node\n", dirs, files,
+                mib_per_sec(buffer.size(), time), time * 1e9 / nodes,
+                mib_per_sec(buffer.size(), reused_time), reused_time * 1e9 / nodes);
+}
+
+// Memory held by the decoded file tree: the heap buffers of vectors (the names refer to the input buffer),
+// and the arena blocks, containing the names too
+void print_memory(size_t dirs, size_t files)
+{
+    std::vector<std::string> names;
+    std::string buffer = easypb::encode(make_file_tree(dirs, files, names));
+
+    auto tree = easypb::decode<filetree::FileTree>(buffer);
+    size_t heap_bytes = 0, heap_allocations = 0;
+    count_heap_memory(tree.root, heap_bytes, heap_allocations);
+
+    easypb::Arena arena;
+    arena_tree::FileTree arena_tree;
+    easypb::decode(buffer, &arena_tree, arena);
+
+    const double MiB = 1024*1024;
+    std::printf("%6zu x %-6zu %8.2f MiB %8zu allocations %8.2f MiB %4zu blocks, including %.2f MiB of names\n", dirs, files,
+                heap_bytes / MiB, heap_allocations,
+                arena.allocated_bytes() / MiB, arena.block_count(), count_name_bytes(arena_tree.root) / MiB);
+}
+
+
+// File tree messages with lazily decoded children, as generated by codegen --lazy-field Node.children --prescan-repeated
+namespace lazy_tree
+{
+
+struct Node
+{
+    easypb::string_view name;
+    uint32_t kind = 0;
+    uint64_t size = 0;
+    int64_t last_write_time_unix_ns = 0;
+    uint32_t permissions = 0;
+    easypb::string_view symlink_target;
+    std::vector<easypb::Lazy<Node>> children;
+};
+
+void encode(easypb::Encoder& pb, const Node& x)
+{
+    pb.put_string(easypb::FieldNum<1>(), x.name);
+    pb.put_fixed32(easypb::FieldNum<2>(), x.kind);
+    pb.put_fixed64(easypb::FieldNum<3>(), x.size);
+    pb.put_sfixed64(easypb::FieldNum<4>(), x.last_write_time_unix_ns);
+    pb.put_fixed32(easypb::FieldNum<5>(), x.permissions);
+    pb.put_string(easypb::FieldNum<6>(), x.symlink_target);
+    pb.put_repeated_message(easypb::FieldNum<7>(), x.children);
+}
+
+easypb::DecodeStatus decode(easypb::Decoder pb, Node& x)
+{
+    static constexpr uint32_t repeated_tags[] = {
+        easypb::field_tag(7, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.children, x.children.size() + repeated_counts[0]);
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_string(&x.name); break;
+            case 2: pb.get_fixed32(&x.kind); break;
+            case 3: pb.get_fixed64(&x.size); break;
+            case 4: pb.get_sfixed64(&x.last_write_time_unix_ns); break;
+            case 5: pb.get_fixed32(&x.permissions); break;
+            case 6: pb.get_string(&x.symlink_target); break;
+            case 7: pb.get_repeated_message(&x.children); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+struct FileTree
+{
+    Node root;
+};
+
+void encode(easypb::Encoder& pb, const FileTree& x)
+{
+    pb.put_message(easypb::FieldNum<1>(), x.root);
+}
+
+easypb::DecodeStatus decode(easypb::Decoder pb, FileTree& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_message(&x.root); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+} // namespace lazy_tree
+
+// Size of the names of the root's children - the only part of the tree used by the "top-level" runs
+size_t count_top_names(const filetree::FileTree& tree)
+{
+    size_t bytes = 0;
+    for (const filetree::Node& child: tree.root.children) {
+        bytes += child.name.size();
+    }
+    return bytes;
+}
+
+size_t count_top_names(const lazy_tree::FileTree& tree)
+{
+    size_t bytes = 0;
+    for (const easypb::Lazy<lazy_tree::Node>& child: tree.root.children) {
+        bytes += child->name.size();
+    }
+    return bytes;
+}
+
+// Decode the file tree, fully and with lazy children, either reading only the names of the top-level
+// directories, or passing the tree through to the encoder unmodified, and print the speed
+void run_lazy(size_t dirs, size_t files, int repeat)
+{
+    std::vector<std::string> names;
+    std::string buffer = easypb::encode(make_file_tree(dirs, files, names));
+
+    size_t sink = 0;
+    auto top_level = [&] (auto tree_type) {
+        return best_time(repeat, [&] {
+            auto tree = easypb::decode<decltype(tree_type)>(buffer);
+            sink += count_top_names(tree);
+        });
+    };
+    auto pass_through = [&] (auto tree_type) {
+        return best_time(repeat, [&] {
+            auto tree = easypb::decode<decltype(tree_type)>(buffer);
+            sink += easypb::encode(tree).size();
+        });
+    };
+    double full_time = top_level(filetree::FileTree());
+    double lazy_time = top_level(lazy_tree::FileTree());
+    double full_pass_time = pass_through(filetree::FileTree());
+    double lazy_pass_time = pass_through(lazy_tree::FileTree());
+    if (sink == 0)  std::printf("unreachable\n");
+
+    std::printf("%6zu x %-6zu %10.2f %10.2f MiB/s %14.2f %10.2f MiB/s\n", dirs, files,
+                mib_per_sec(buffer.size(), full_time), mib_per_sec(buffer.size(), lazy_time),
+                mib_per_sec(buffer.size(), full_pass_time), mib_per_sec(buffer.size(), lazy_pass_time));
+}
+#endif
+
+
+int main(int argc, char** argv)
+{
+    try {
+        int repeat = (argc > 1? std::atoi(argv[1]) : 100);
+
+        std::printf("map of 100000 entries\n");
+        run_map<MapMessage<std::map<std::string,std::string>>>("map<string,string>", 100000, repeat);
+        run_map<MapMessage<std::unordered_map<std::string,std::string>>>("unordered_map<string,string>", 100000, repeat);
+        run_map<IdMapMessage<std::map<uint64_t,std::string>>>("map<fixed64,string>", 100000, repeat);
+        run_map<IdMapMessage<std::unordered_map<uint64_t,std::string>>>("unordered_map<fixed64,string>", 100000, repeat);
+
+#if __cplusplus >= 201703L
+        std::printf("\n  dirs x files              new tree                  reused tree\n");
+        run(10, 10000, repeat);
+        run(1000, 100, repeat);
+        run(10000, 10, repeat);
+        run(100000, 1, repeat);
+
+        std::printf("\n  dirs x files             new arena                 reused arena\n");
+        run_arena(10, 10000, repeat);
+        run_arena(1000, 100, repeat);
+        run_arena(10000, 10, repeat);
+        run_arena(100000, 1, repeat);
+
+        std::printf("\n  dirs x files         heap vectors                    arena\n");
+        print_memory(10, 10000);
+        print_memory(1000, 100);
+        print_memory(10000, 10);
+        print_memory(100000, 1);
+
+        std::printf("\n  dirs x files      top-level: full       lazy     pass-through: full       lazy\n");
+        run_lazy(10, 10000, repeat);
+        run_lazy(1000, 100, repeat);
+        run_lazy(10000, 10, repeat);
+        run_lazy(100000, 1, repeat);
+#else
+        std::printf("\nfile trees require C++17\n");
+#endif
+    } catch (const std::exception& e) {
+        std::printf("Exception: %s\n", e.what());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Encoding speed of messages with many small fields, where writing the field tags is a noticeable part of the work:
+// the tutorial schema, and (in C++17 mode) the file-tree schema
+//   Usage: encode [repeat]
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "../tutorial/tutorial.pb.cpp"
+
+
+// Encode `count` messages into a reused Encoder and print the speed
+template <typename MessageType>
+void run(const char* name, const MessageType& msg, size_t count, int repeat)
+{
+    easypb::Encoder pb;
+    double time = best_time(repeat, [&] {
+        pb.reset();
+        for (size_t i = 0; i < count; i++)  encode(pb, msg);
+    });
+
+    size_t bytes = pb.pos();
+    std::printf("%-10s %10.2f ns/message %10.2f MiB/s %8zu bytes/message\n", name,
+                time * 1e9 / count, mib_per_sec(bytes, time), bytes / count);
+}
+
+// The tutorial message with all fields filled
+MainMessage make_tutorial_message()
+{
+    MainMessage msg;
+    msg.opt_uint32   = 101;
+    msg.req_sfixed64 = -102;
+    msg.opt_double   = 103.14;
+    msg.req_bytes    = "104";
+
+    SubMessage sub;
+    sub.req_int64   = -201;
+    sub.opt_sint32  = -202;
+    sub.req_uint64  = 203;
+    sub.opt_fixed32 = 204;
+    sub.req_float   = -205.42f;
+    sub.opt_string  = "206";
+    sub.rep_int32   = {1, 2, 3};
+    sub.rep_uint64  = {300, 400};
+    sub.rep_double  = {0.5};
+    msg.req_msg = sub;
+
+    msg.rep_sint32  = {-1, 2, -3, 4};
+    msg.rep_fixed64 = {5, 6};
+    msg.rep_string  = {"seven", "eight"};
+    msg.rep_msg     = {sub, sub, sub};
+    msg.mappa[1] = 1234;
+    msg.mappa[2] = 4321;
+    return msg;
+}
+
+
+int main(int argc, char** argv)
+{
+    try {
+        int repeat = (argc > 1? std::atoi(argv[1]) : 100);
+
+        run("tutorial", make_tutorial_message(), 10000, repeat);
+
+#if __cplusplus >= 201703L
+        std::vector<std::string> names;
+        run("filetree", make_file_tree(1000, 100, names), 1, repeat);
+#else
+        std::printf("filetree   requires C++17\n");
+#endif
+    } catch (const std::exception& e) {
+        std::printf("Exception: %s\n", e.what());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Encoding and decoding speed of repeated fields of each scalar type,
+// both packed and unpacked
+//   Usage: field_types [values]
+#include <cstdlib>
+#include <exception>
+
+#include "benchmark.hpp"
+
+
+// Encode `values` into field #1, decode it back and print the speed in ns per value
+template <typename Values, typename Encode, typename Decode>
+void run(const char* name, const char* mode, const Values& values, Encode encode, Decode decode)
+{
+    easypb::Encoder pb;
+    std::string data;
+    double encode_time = best_time(200, [&] {
+        pb.reset();
+        encode(pb, values);
+        data = pb.result();
+    });
+
+    Values decoded;
+    double decode_time = best_time(200, [&] {
+        decoded.clear();
+        easypb::Decoder pb(data);
+        while (pb.get_next_field())  decode(pb, &decoded);
+    });
+    if (decoded != values)  throw std::runtime_error(std::string("Decoded values differ for ") + name);
+
+    std::printf("%-8s %-9s %8.2f %8.2f %10.2f\n", name, mode,
+                encode_time * 1e9 / values.size(),
+                decode_time * 1e9 / values.size(),
+                double(data.size()) / values.size());
+}
+
+#define BENCHMARK_FIELD_TYPE(TYPE, VALUES)                                    \
+    run(#TYPE, "packed", VALUES,                                              \
+        [](easypb::Encoder& pb, const decltype(VALUES)& v) {pb.put_packed_##TYPE(1, v);},    \
+        [](easypb::Decoder& pb, decltype(&VALUES) v) {pb.get_repeated_##TYPE(v);});    \
+    run(#TYPE, "unpacked", VALUES,                                            \
+        [](easypb::Encoder& pb, const decltype(VALUES)& v) {pb.put_repeated_##TYPE(1, v);},  \
+        [](easypb::Decoder& pb, decltype(&VALUES) v) {pb.get_repeated_##TYPE(v);});
+
+
+int main(int argc, char** argv)
+{
+    try {
+        size_t count = (argc > 1? std::strtoul(argv[1], nullptr, 10) : 10000);
+
+        std::mt19937_64 rng(42);
+        auto random = [&](uint64_t limit) {return rng() % limit;};
+
+        std::vector<int32_t>  int32_values, sint32_values;
+        std::vector<int64_t>  int64_values, sint64_values;
+        std::vector<uint64_t> uint64_values, fixed64_values;
+        std::vector<uint32_t> fixed32_values;
+        std::vector<float>    float_values;
+        std::vector<double>   double_values;
+        std::vector<bool>     bool_values;
+        std::vector<std::string> string_values;
+
+        for (size_t i = 0; i < count; i++) {
+            int32_values  .push_back(int32_t(random(1000)));
+            int64_values  .push_back(int64_t(rng() >> random(64)));
+            uint64_values .push_back(rng() >> random(64));
+            // Time-series deltas: small values of both signs, and for sint64 of widely varying magnitude
+            sint32_values .push_back(int32_t(random(200)) - 100);
+            sint64_values .push_back(int64_t(rng() >> (40 + random(24))) * (random(2)? 1 : -1));
+            fixed32_values.push_back(uint32_t(rng()));
+            fixed64_values.push_back(rng());
+            float_values  .push_back(random(1000) / 10.0f);
+            double_values .push_back(random(1000000) / 1000.0);
+            bool_values   .push_back(random(2) != 0);
+            string_values .push_back("value-" + std::to_string(random(1000)));
+        }
+
+        std::printf("%-8s %-9s %8s %8s %10s\n", "type", "mode", "encode", "decode", "bytes");
+        std::printf("%-8s %-9s %8s %8s %10s\n", "", "", "ns/value", "ns/value", "per value");
+        BENCHMARK_FIELD_TYPE(int32,   int32_values)
+        BENCHMARK_FIELD_TYPE(int64,   int64_values)
+        BENCHMARK_FIELD_TYPE(uint64,  uint64_values)
+        BENCHMARK_FIELD_TYPE(sint32,  sint32_values)
+        BENCHMARK_FIELD_TYPE(sint64,  sint64_values)
+        BENCHMARK_FIELD_TYPE(fixed32, fixed32_values)
+        BENCHMARK_FIELD_TYPE(fixed64, fixed64_values)
+        BENCHMARK_FIELD_TYPE(float,   float_values)
+        BENCHMARK_FIELD_TYPE(double,  double_values)
+        BENCHMARK_FIELD_TYPE(bool,    bool_values)
+
+        run("string", "unpacked", string_values,
+            [](easypb::Encoder& pb, const std::vector<std::string>& v) {pb.put_repeated_string(1, v);},
+            [](easypb::Decoder& pb, std::vector<std::string>* v) {pb.get_repeated_string(v);});
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
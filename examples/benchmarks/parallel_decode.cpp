@@ -0,0 +1,37 @@
+// Scaling of easypb::decode_records_parallel() with the number of threads
+//   Usage: parallel_decode [records [max_threads]]
+#define EASYPB_PARALLEL
+#include <cstdlib>
+#include <exception>
+#include <thread>
+
+#include "benchmark.hpp"
+
+
+int main(int argc, char** argv)
+{
+    try {
+        size_t records = (argc > 1? std::strtoul(argv[1], nullptr, 10) : 200000);
+        unsigned max_threads = (argc > 2? unsigned(std::strtoul(argv[2], nullptr, 10)) : std::thread::hardware_concurrency());
+        if (max_threads == 0)  max_threads = 1;
+
+        std::string corpus = make_corpus(records);
+        std::printf("Corpus: %zu records, %.2f MiB\n", records, corpus.size() / (1024.0*1024));
+
+        double base_time = 0;
+        for (unsigned threads = 1; threads <= max_threads; threads++) {
+            size_t decoded = 0;
+            double time = best_time(5, [&] {
+                decoded = easypb::decode_records_parallel<Record>(corpus, threads).size();
+            });
+            if (decoded != records)  throw std::runtime_error("Decoded " + std::to_string(decoded) + " records");
+            if (threads == 1)  base_time = time;
+
+            std::printf("%3u threads: %8.2f MiB/s, %5.2fx\n", threads, mib_per_sec(corpus.size(), time), base_time / time);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
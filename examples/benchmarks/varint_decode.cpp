@@ -0,0 +1,78 @@
+// Decoder::read_varint() speed for varints of various lengths,
+// compared with the byte-at-a-time loop used by EasyProtoBuf before
+//   Usage: varint_decode [varints]
+#include <cstdlib>
+#include <exception>
+
+#include "benchmark.hpp"
+
+
+// The original Decoder::read_varint(), branching on each byte
+struct BytewiseDecoder
+{
+    const char* ptr;
+    const char* buf_end;
+
+    uint64_t read_varint()
+    {
+        if(buf_end - ptr < 10)  throw std::runtime_error("No padding");
+
+        auto p = (const uint8_t*)ptr;
+        uint64_t value = 0;
+        for (int n = 0; n < 10; n++) {
+            value |= uint64_t(p[n] & 127) << (n*7);
+            if(p[n] < 128)  {ptr += n + 1;  return value;}
+        }
+        throw easypb::varint_too_long("More than 10 bytes in varint");
+    }
+};
+
+// Varints of the given length in bytes, or mixed lengths if bytes==0
+std::string make_varints(size_t count, int bytes)
+{
+    std::mt19937_64 rng(42);
+    easypb::Encoder pb;
+    for (size_t i = 0; i < count; i++) {
+        int len = (bytes? bytes : 1 + int(rng() % 10));
+        uint64_t value = (len == 1? rng() % 128 : (uint64_t(1) << (7*(len-1))) | (rng() >> (64 - 7*(len-1))));
+        if (len == 10)  value = rng() | (uint64_t(1) << 63);
+        pb.write_varint(value);
+    }
+    // Padding, so that all varints are decoded by the fast path
+    for (int i = 0; i < 10; i++)  pb.write_varint(0);
+    return pb.result();
+}
+
+
+int main(int argc, char** argv)
+{
+    try {
+        size_t count = (argc > 1? std::strtoul(argv[1], nullptr, 10) : 10000000);
+
+        std::printf("%-10s %14s %14s %9s\n", "varints", "bytewise", "read_varint", "speedup");
+        for (int bytes: {1, 2, 3, 5, 10, 0}) {
+            std::string data = make_varints(count, bytes);
+            uint64_t sum1 = 0, sum2 = 0;
+
+            double time1 = best_time(5, [&] {
+                BytewiseDecoder pb{data.data(), data.data() + data.size()};
+                sum1 = 0;
+                for (size_t i = 0; i < count; i++)  sum1 += pb.read_varint();
+            });
+            double time2 = best_time(5, [&] {
+                easypb::Decoder pb(data);
+                sum2 = 0;
+                for (size_t i = 0; i < count; i++)  sum2 += pb.read_varint();
+            });
+            if (sum1 != sum2)  throw std::runtime_error("Decoded values differ");
+
+            std::string name = (bytes? std::to_string(bytes) + "-byte" : std::string("mixed"));
+            std::printf("%-10s %8.2f ns/op %8.2f ns/op %8.2fx\n", name.c_str(),
+                        time1 * 1e9 / count, time2 * 1e9 / count, time1 / time2);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -38,23 +38,47 @@ struct Node
 
 inline void encode(easypb::Encoder& pb, const Node& x)
 {
-    pb.put_string(1, x.name);
-    pb.put_fixed32(2, x.kind);
+    pb.put_string(easypb::FieldNum<1>(), x.name);
+    pb.put_fixed32(easypb::FieldNum<2>(), x.kind);
 
     if (x.has_size)
-        pb.put_fixed64(3, x.size);
+        pb.put_fixed64(easypb::FieldNum<3>(), x.size);
     if (x.has_last_write_time_unix_ns)
-        pb.put_sfixed64(4, x.last_write_time_unix_ns);
+        pb.put_sfixed64(easypb::FieldNum<4>(), x.last_write_time_unix_ns);
     if (x.has_permissions)
-        pb.put_fixed32(5, x.permissions);
+        pb.put_fixed32(easypb::FieldNum<5>(), x.permissions);
     if (x.has_symlink_target)
-        pb.put_string(6, x.symlink_target);
+        pb.put_string(easypb::FieldNum<6>(), x.symlink_target);
 
-    pb.put_repeated_message(7, x.children);
+    pb.put_repeated_message(easypb::FieldNum<7>(), x.children);
 }
 
-inline void decode(easypb::Decoder pb, Node& x)
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, Node& x)
 {
+    // Reset the fields, but decode the children over the existing ones, as codegen --reuse-storage does.
+    // A repeated occurrence of the message is merged into the first one, appending the children
+    std::size_t children_count = (pb.merging? x.children.size() : 0);
+    if (!pb.merging)
+    {
+        x.name = {};
+        x.kind = 0;
+        x.size = 0;
+        x.last_write_time_unix_ns = 0;
+        x.permissions = 0;
+        x.symlink_target = {};
+        x.has_name = x.has_kind = x.has_size = false;
+        x.has_last_write_time_unix_ns = x.has_permissions = x.has_symlink_target = false;
+    }
+
+    // Count the children first to allocate them at once, as codegen --prescan-repeated does
+    static constexpr std::uint32_t repeated_tags[] = {
+        easypb::field_tag(7, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    std::size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.children, children_count + repeated_counts[0]);
+
     while (pb.get_next_field())
     {
         switch (pb.field_num)
@@ -80,19 +104,20 @@ inline void decode(easypb::Decoder pb, Node& x)
                 pb.get_string(&x.symlink_target, &x.has_symlink_target);
                 break;
             case 7:
-                pb.get_repeated_message(&x.children);
+                pb.get_repeated_message(&x.children, &children_count);
                 break;
             default:
                 pb.skip_field();
         }
     }
+    easypb::truncate(x.children, children_count);
 
     if (!x.has_name)
-        throw easypb::missing_required_field(
-            "Decoded protobuf has no required field filetree.Node.name");
+        return pb.missing_field("filetree.Node.name");
     if (!x.has_kind)
-        throw easypb::missing_required_field(
-            "Decoded protobuf has no required field filetree.Node.kind");
+        return pb.missing_field("filetree.Node.kind");
+
+    return pb.status;
 }
 
 struct FileTree
@@ -103,11 +128,14 @@ struct FileTree
 
 inline void encode(easypb::Encoder& pb, const FileTree& x)
 {
-    pb.put_message(1, x.root);
+    pb.put_message(easypb::FieldNum<1>(), x.root);
 }
 
-inline void decode(easypb::Decoder pb, FileTree& x)
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, FileTree& x)
 {
+    if (!pb.merging)
+        x.has_root = false;
     while (pb.get_next_field())
     {
         switch (pb.field_num)
@@ -121,8 +149,9 @@ inline void decode(easypb::Decoder pb, FileTree& x)
     }
 
     if (!x.has_root)
-        throw easypb::missing_required_field(
-            "Decoded protobuf has no required field filetree.FileTree.root");
+        return pb.missing_field("filetree.FileTree.root");
+
+    return pb.status;
 }
 
 } // namespace filetree
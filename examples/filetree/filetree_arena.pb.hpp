@@ -0,0 +1,114 @@
+#ifndef FILETREE_ARENA_PB_HPP_INCLUDED
+#define FILETREE_ARENA_PB_HPP_INCLUDED
+
+#include <cstdint>
+#include <string_view>
+
+#include <easypb.hpp>
+
+// The same schema decoded into easypb::Arena, as generated by codegen --arena --prescan-repeated.
+// The children vectors and the names are allocated from the arena of the Decoder,
+// so the decoded tree doesn't refer to the serialized buffer and is freed at once with the arena
+namespace filetree_arena
+{
+
+struct Node
+{
+    std::string_view name;
+    std::uint32_t kind = 0;
+    std::uint64_t size = 0;
+    std::int64_t last_write_time_unix_ns = 0;
+    std::uint32_t permissions = 0;
+    std::string_view symlink_target;
+    easypb::ArenaVector<Node> children;
+
+    bool has_name = false;
+    bool has_kind = false;
+    bool has_size = false;
+    bool has_last_write_time_unix_ns = false;
+    bool has_permissions = false;
+    bool has_symlink_target = false;
+};
+
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, Node& x)
+{
+    easypb::attach_arena(x.children, pb.arena);
+
+    static constexpr std::uint32_t repeated_tags[] = {
+        easypb::field_tag(7, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    std::size_t repeated_counts[1];
+    pb.prescan_fields(repeated_tags, repeated_counts);
+    easypb::reserve_space(x.children, x.children.size() + repeated_counts[0]);
+
+    while (pb.get_next_field())
+    {
+        switch (pb.field_num)
+        {
+            case 1:
+                pb.get_string(&x.name, &x.has_name);
+                break;
+            case 2:
+                pb.get_fixed32(&x.kind, &x.has_kind);
+                break;
+            case 3:
+                pb.get_fixed64(&x.size, &x.has_size);
+                break;
+            case 4:
+                pb.get_sfixed64(
+                    &x.last_write_time_unix_ns,
+                    &x.has_last_write_time_unix_ns);
+                break;
+            case 5:
+                pb.get_fixed32(&x.permissions, &x.has_permissions);
+                break;
+            case 6:
+                pb.get_string(&x.symlink_target, &x.has_symlink_target);
+                break;
+            case 7:
+                pb.get_repeated_message(&x.children);
+                break;
+            default:
+                pb.skip_field();
+        }
+    }
+
+    if (!x.has_name)
+        return pb.missing_field("filetree.Node.name");
+    if (!x.has_kind)
+        return pb.missing_field("filetree.Node.kind");
+
+    return pb.status;
+}
+
+struct FileTree
+{
+    Node root;
+    bool has_root = false;
+};
+
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, FileTree& x)
+{
+    while (pb.get_next_field())
+    {
+        switch (pb.field_num)
+        {
+            case 1:
+                pb.get_message(&x.root, &x.has_root);
+                break;
+            default:
+                pb.skip_field();
+        }
+    }
+
+    if (!x.has_root)
+        return pb.missing_field("filetree.FileTree.root");
+
+    return pb.status;
+}
+
+} // namespace filetree_arena
+
+#endif // FILETREE_ARENA_PB_HPP_INCLUDED
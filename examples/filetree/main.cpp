@@ -1,4 +1,5 @@
 #include "filetree.pb.hpp"
+#include "filetree_arena.pb.hpp"
 
 #include <algorithm>
 #include <chrono>
@@ -674,7 +675,8 @@ struct TreeStatistics
     }
 };
 
-void collect_statistics(const filetree::Node& node, TreeStatistics& statistics)
+template <typename NodeType>
+void collect_statistics(const NodeType& node, TreeStatistics& statistics)
 {
     ++statistics.entries;
 
@@ -704,18 +706,21 @@ void collect_statistics(const filetree::Node& node, TreeStatistics& statistics)
             break;
     }
 
-    for (const filetree::Node& child : node.children)
+    for (const NodeType& child : node.children)
         collect_statistics(child, statistics);
 }
 
-TreeStatistics collect_statistics(const filetree::FileTree& tree)
+template <typename TreeType>
+TreeStatistics collect_statistics(const TreeType& tree)
 {
     TreeStatistics statistics;
     collect_statistics(tree.root, statistics);
     return statistics;
 }
 
-bool equivalent(const filetree::Node& left, const filetree::Node& right)
+// The right tree may be decoded into other structures, e.g. filetree_arena::Node
+template <typename NodeType>
+bool equivalent(const filetree::Node& left, const NodeType& right)
 {
     if (left.name != right.name ||
         left.kind != right.kind ||
@@ -744,12 +749,29 @@ bool equivalent(const filetree::Node& left, const filetree::Node& right)
     return true;
 }
 
-bool equivalent(const filetree::FileTree& left, const filetree::FileTree& right)
+template <typename TreeType>
+bool equivalent(const filetree::FileTree& left, const TreeType& right)
 {
     return left.has_root == right.has_root &&
            (!left.has_root || equivalent(left.root, right.root));
 }
 
+// Heap memory held by the vectors of children: the bytes and the number of allocations.
+// The names of the decoded tree refer to the serialized buffer
+void count_heap_memory(
+    const filetree::Node& node,
+    std::uint64_t& bytes,
+    std::uint64_t& allocations)
+{
+    if (node.children.capacity() != 0)
+    {
+        bytes += node.children.capacity() * sizeof(filetree::Node);
+        ++allocations;
+    }
+    for (const filetree::Node& child : node.children)
+        count_heap_memory(child, bytes, allocations);
+}
+
 struct StageResult
 {
     const char* name;
@@ -783,7 +805,7 @@ void print_stage(const StageResult& stage)
     const std::string entries_per_second =
         format_grouped_fixed(stage.entries_per_second, 0);
 
-    std::cout << std::left << std::setw(10) << stage.name
+    std::cout << std::left << std::setw(14) << stage.name
               << std::right << std::setw(13) << seconds
               << std::setw(15) << mebibytes_per_second
               << std::setw(17) << entries_per_second << '\n';
@@ -795,9 +817,14 @@ void print_report(
     std::uint64_t scan_errors,
     const NameArena& arena,
     std::size_t wire_size,
+    std::uint64_t heap_bytes,
+    std::uint64_t heap_allocations,
+    const easypb::Arena& decode_arena,
     double scan_seconds,
     double encode_seconds,
-    double decode_seconds)
+    double reencode_seconds,
+    double decode_seconds,
+    double arena_decode_seconds)
 {
     const double logical_mib = static_cast<double>(statistics.logical_file_bytes) / mib;
     const double wire_mib = static_cast<double>(wire_size) / mib;
@@ -838,8 +865,17 @@ void print_report(
               << " buffers\n"
               << "Serialized buffer:  "
               << format_grouped_integer(static_cast<std::uint64_t>(wire_size))
-              << " bytes (" << format_grouped_fixed(wire_mib, 3) << " MiB)\n\n"
-              << std::left << std::setw(10) << "Stage"
+              << " bytes (" << format_grouped_fixed(wire_mib, 3) << " MiB)\n"
+              << "Decoded tree:  heap vectors "
+              << format_grouped_integer(heap_bytes)
+              << " bytes = "
+              << format_grouped_integer(heap_allocations)
+              << " allocations,  arena "
+              << format_grouped_integer(static_cast<std::uint64_t>(decode_arena.allocated_bytes()))
+              << " bytes = "
+              << format_grouped_integer(static_cast<std::uint64_t>(decode_arena.block_count()))
+              << " blocks, including the names\n\n"
+              << std::left << std::setw(14) << "Stage"
               << std::right << std::setw(13) << "Time (s)"
               << std::setw(15) << "MiB/s"
               << std::setw(17) << "Entries/s" << '\n';
@@ -854,11 +890,21 @@ void print_report(
         encode_seconds,
         wire_mib / std::max(encode_seconds, 1e-12),
         rate(statistics.entries, encode_seconds)});
+    print_stage({
+        "Re-encode",
+        reencode_seconds,
+        wire_mib / std::max(reencode_seconds, 1e-12),
+        rate(statistics.entries, reencode_seconds)});
     print_stage({
         "Decode",
         decode_seconds,
         wire_mib / std::max(decode_seconds, 1e-12),
         rate(statistics.entries, decode_seconds)});
+    print_stage({
+        "Arena decode",
+        arena_decode_seconds,
+        wire_mib / std::max(arena_decode_seconds, 1e-12),
+        rate(statistics.entries, arena_decode_seconds)});
 }
 
 } // namespace filetree_benchmark
@@ -903,6 +949,16 @@ int main(int argc, char** argv)
         std::string wire = easypb::encode(source);
         const clock::time_point encode_end = clock::now();
 
+        // Encode once more into an Encoder whose buffer has already grown to the full size
+        easypb::Encoder encoder;
+        encode(encoder, source);
+        encoder.reset();
+        const clock::time_point reencode_start = clock::now();
+        encode(encoder, source);
+        const clock::time_point reencode_end = clock::now();
+        if (encoder.view() != wire)
+            throw std::runtime_error("re-encoded buffer differs from the first one");
+
         const clock::time_point decode_start = clock::now();
         filetree::FileTree decoded = easypb::decode<filetree::FileTree>(wire);
         const clock::time_point decode_end = clock::now();
@@ -913,12 +969,32 @@ int main(int argc, char** argv)
         if (!(source_statistics == decoded_statistics))
             throw std::runtime_error("decoded aggregate statistics differ from the source");
 
+        std::uint64_t heap_bytes = 0;
+        std::uint64_t heap_allocations = 0;
+        count_heap_memory(decoded.root, heap_bytes, heap_allocations);
+
+        // Decode once more into an arena, copying the names out of the serialized buffer
+        easypb::Arena decode_arena;
+        filetree_arena::FileTree arena_decoded;
+        const clock::time_point arena_decode_start = clock::now();
+        easypb::decode(wire, &arena_decoded, decode_arena);
+        const clock::time_point arena_decode_end = clock::now();
+
+        if (!equivalent(source, arena_decoded))
+            throw std::runtime_error("arena-decoded tree differs from the scanned tree");
+        if (!(source_statistics == collect_statistics(arena_decoded)))
+            throw std::runtime_error("arena-decoded aggregate statistics differ from the source");
+
         const double scan_seconds =
             std::chrono::duration<double>(scan_end - scan_start).count();
         const double encode_seconds =
             std::chrono::duration<double>(encode_end - encode_start).count();
+        const double reencode_seconds =
+            std::chrono::duration<double>(reencode_end - reencode_start).count();
         const double decode_seconds =
             std::chrono::duration<double>(decode_end - decode_start).count();
+        const double arena_decode_seconds =
+            std::chrono::duration<double>(arena_decode_end - arena_decode_start).count();
 
         progress.clear();
         print_report(
@@ -927,9 +1003,14 @@ int main(int argc, char** argv)
             scan_errors,
             arena,
             wire.size(),
+            heap_bytes,
+            heap_allocations,
+            decode_arena,
             scan_seconds,
             encode_seconds,
-            decode_seconds);
+            reencode_seconds,
+            decode_seconds,
+            arena_decode_seconds);
         std::cout << "\nValidation: OK\n";
         return 0;
     }
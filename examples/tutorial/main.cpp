@@ -77,6 +77,28 @@ int main()
             printf("Data restored correctly!\n");
         }
 
+        // Encode message with minimal-length prefixes of nested messages
+        std::string compact_buffer = easypb::encode_compact(orig_msg);
+        auto compact_msg = easypb::decode<MainMessage>(compact_buffer);
+
+        error = compare(orig_msg, compact_msg);
+        if (error) {
+            printf("Incorrectly restored field from compact encoding: %s\n", error);
+            return 1;
+        } else {
+            printf("Compact encoding: %zu bytes instead of %zu\n", compact_buffer.size(), buffer.size());
+        }
+
+        // Decode our own data without per-field bound checks
+        MainMessage trusted_msg;
+        decode(easypb::TrustedDecoder(buffer), trusted_msg);
+
+        error = compare(orig_msg, trusted_msg);
+        if (error) {
+            printf("Incorrectly restored field by TrustedDecoder: %s\n", error);
+            return 1;
+        }
+
     } catch (const std::exception& e) {
         printf("Exception: %s\n", e.what());
         return 2;
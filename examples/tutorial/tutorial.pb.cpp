@@ -35,22 +35,40 @@ EASYPB_SubMessage_EXTRA_FIELDS
 
 inline void encode(easypb::Encoder &pb, const SubMessage &x)
 {
-    pb.put_int64(1, x.req_int64);
-    pb.put_sint32(2, x.opt_sint32);
-    pb.put_uint64(3, x.req_uint64);
-    pb.put_fixed32(4, x.opt_fixed32);
-    pb.put_float(5, x.req_float);
-    pb.put_string(6, x.opt_string);
-    pb.put_repeated_int32(11, x.rep_int32);
-    pb.put_repeated_uint64(12, x.rep_uint64);
-    pb.put_repeated_double(13, x.rep_double);
+    pb.put_int64(easypb::FieldNum<1>(), x.req_int64);
+    pb.put_sint32(easypb::FieldNum<2>(), x.opt_sint32);
+    pb.put_uint64(easypb::FieldNum<3>(), x.req_uint64);
+    pb.put_fixed32(easypb::FieldNum<4>(), x.opt_fixed32);
+    pb.put_float(easypb::FieldNum<5>(), x.req_float);
+    pb.put_string(easypb::FieldNum<6>(), x.opt_string);
+    pb.put_repeated_int32(easypb::FieldNum<11>(), x.rep_int32);
+    pb.put_repeated_uint64(easypb::FieldNum<12>(), x.rep_uint64);
+    pb.put_repeated_double(easypb::FieldNum<13>(), x.rep_double);
 
 #ifdef EASYPB_SubMessage_EXTRA_ENCODING
 EASYPB_SubMessage_EXTRA_ENCODING(pb, x)
 #endif
 }
 
-inline void decode(easypb::Decoder pb, SubMessage &x)
+inline void encode(easypb::Sizer &pb, const SubMessage &x)
+{
+    pb.put_int64(easypb::FieldNum<1>(), x.req_int64);
+    pb.put_sint32(easypb::FieldNum<2>(), x.opt_sint32);
+    pb.put_uint64(easypb::FieldNum<3>(), x.req_uint64);
+    pb.put_fixed32(easypb::FieldNum<4>(), x.opt_fixed32);
+    pb.put_float(easypb::FieldNum<5>(), x.req_float);
+    pb.put_string(easypb::FieldNum<6>(), x.opt_string);
+    pb.put_repeated_int32(easypb::FieldNum<11>(), x.rep_int32);
+    pb.put_repeated_uint64(easypb::FieldNum<12>(), x.rep_uint64);
+    pb.put_repeated_double(easypb::FieldNum<13>(), x.rep_double);
+
+#ifdef EASYPB_SubMessage_EXTRA_ENCODING
+EASYPB_SubMessage_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, SubMessage &x)
 {
     while(pb.get_next_field())
     {
@@ -77,17 +95,18 @@ EASYPB_SubMessage_EXTRA_POST_DECODING(pb, x)
 #endif
 
     if(! x.has_req_int64) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field SubMessage.req_int64");
+        return pb.missing_field("SubMessage.req_int64");
     }
 
     if(! x.has_req_uint64) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field SubMessage.req_uint64");
+        return pb.missing_field("SubMessage.req_uint64");
     }
 
     if(! x.has_req_float) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field SubMessage.req_float");
+        return pb.missing_field("SubMessage.req_float");
     }
 
+    return pb.status;
 }
 
 struct MainMessage
@@ -116,23 +135,42 @@ EASYPB_MainMessage_EXTRA_FIELDS
 
 inline void encode(easypb::Encoder &pb, const MainMessage &x)
 {
-    pb.put_uint32(1, x.opt_uint32);
-    pb.put_sfixed64(2, x.req_sfixed64);
-    pb.put_double(3, x.opt_double);
-    pb.put_bytes(4, x.req_bytes);
-    pb.put_message(5, x.req_msg);
-    pb.put_repeated_sint32(11, x.rep_sint32);
-    pb.put_repeated_fixed64(12, x.rep_fixed64);
-    pb.put_repeated_string(13, x.rep_string);
-    pb.put_repeated_message(14, x.rep_msg);
-    pb.put_map_int32_int32(15, x.mappa);
+    pb.put_uint32(easypb::FieldNum<1>(), x.opt_uint32);
+    pb.put_sfixed64(easypb::FieldNum<2>(), x.req_sfixed64);
+    pb.put_double(easypb::FieldNum<3>(), x.opt_double);
+    pb.put_bytes(easypb::FieldNum<4>(), x.req_bytes);
+    pb.put_message(easypb::FieldNum<5>(), x.req_msg);
+    pb.put_repeated_sint32(easypb::FieldNum<11>(), x.rep_sint32);
+    pb.put_repeated_fixed64(easypb::FieldNum<12>(), x.rep_fixed64);
+    pb.put_repeated_string(easypb::FieldNum<13>(), x.rep_string);
+    pb.put_repeated_message(easypb::FieldNum<14>(), x.rep_msg);
+    pb.put_map_int32_int32(easypb::FieldNum<15>(), x.mappa);
+
+#ifdef EASYPB_MainMessage_EXTRA_ENCODING
+EASYPB_MainMessage_EXTRA_ENCODING(pb, x)
+#endif
+}
+
+inline void encode(easypb::Sizer &pb, const MainMessage &x)
+{
+    pb.put_uint32(easypb::FieldNum<1>(), x.opt_uint32);
+    pb.put_sfixed64(easypb::FieldNum<2>(), x.req_sfixed64);
+    pb.put_double(easypb::FieldNum<3>(), x.opt_double);
+    pb.put_bytes(easypb::FieldNum<4>(), x.req_bytes);
+    pb.put_message(easypb::FieldNum<5>(), x.req_msg);
+    pb.put_repeated_sint32(easypb::FieldNum<11>(), x.rep_sint32);
+    pb.put_repeated_fixed64(easypb::FieldNum<12>(), x.rep_fixed64);
+    pb.put_repeated_string(easypb::FieldNum<13>(), x.rep_string);
+    pb.put_repeated_message(easypb::FieldNum<14>(), x.rep_msg);
+    pb.put_map_int32_int32(easypb::FieldNum<15>(), x.mappa);
 
 #ifdef EASYPB_MainMessage_EXTRA_ENCODING
 EASYPB_MainMessage_EXTRA_ENCODING(pb, x)
 #endif
 }
 
-inline void decode(easypb::Decoder pb, MainMessage &x)
+template <typename InputPolicy>
+inline easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, MainMessage &x)
 {
     while(pb.get_next_field())
     {
@@ -160,15 +198,16 @@ EASYPB_MainMessage_EXTRA_POST_DECODING(pb, x)
 #endif
 
     if(! x.has_req_sfixed64) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field MainMessage.req_sfixed64");
+        return pb.missing_field("MainMessage.req_sfixed64");
     }
 
     if(! x.has_req_bytes) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field MainMessage.req_bytes");
+        return pb.missing_field("MainMessage.req_bytes");
     }
 
     if(! x.has_req_msg) {
-        throw easypb::missing_required_field("Decoded protobuf has no required field MainMessage.req_msg");
+        return pb.missing_field("MainMessage.req_msg");
     }
 
+    return pb.status;
 }
@@ -1,23 +1,80 @@
 // SPDX-License-Identifier: Unlicense
 /*
 This header file contains the entire EasyProtoBuf library.
-It consists of 3 big sections:
+It consists of 5 big sections:
 - Utility functions shared by Encoder and Decoder
 - Encoder class
+- Sizer class, computing the exact size of encoded data
 - Decoder class
+- Record streams: sequences of length-prefixed messages
 */
 #pragma once
 
 #include <string>
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
 #include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
+#include <vector>
+#ifdef EASYPB_PARALLEL
+#include <exception>
+#include <thread>
+#endif
 #if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
 #include <string_view>
 #endif
+#if defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Hot helpers called from many places, which compilers tend to stop inlining as the call count grows
+#if defined(__GNUC__) || defined(__clang__)
+#define EASYPB_FORCE_INLINE  inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define EASYPB_FORCE_INLINE  __forceinline
+#else
+#define EASYPB_FORCE_INLINE  inline
+#endif
+
+// Decoders generated by codegen --prescan-repeated count the repeated fields of messages at least that long
+// to reserve space for them. Smaller messages have too few fields to compensate for the scan
+#ifndef EASYPB_PRESCAN_MIN_SIZE
+#define EASYPB_PRESCAN_MIN_SIZE  256
+#endif
+
+// Codegen surrounds the table-driven decoders with these macros. Their field tables use offsetof(),
+// that's conditionally-supported for non-standard-layout messages (e.g. with std::map fields),
+// but works fine with all compilers we support
+#if defined(__GNUC__) || defined(__clang__)
+#define EASYPB_TABLE_DECODER_BEGIN  _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Winvalid-offsetof\"")
+#define EASYPB_TABLE_DECODER_END    _Pragma("GCC diagnostic pop")
+#else
+#define EASYPB_TABLE_DECODER_BEGIN
+#define EASYPB_TABLE_DECODER_END
+#endif
+
+// With EASYPB_NO_EXCEPTIONS, Decoder reports malformed input by its sticky `status` instead of exceptions.
+// It's defined automatically when exceptions are disabled, e.g. by -fno-exceptions.
+// The remaining errors (Encoder misuse, buffer overflow, out of memory) throw if exceptions are enabled,
+// and call std::abort() otherwise
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define EASYPB_THROW(EXCEPTION)  throw EXCEPTION
+#else
+#define EASYPB_THROW(EXCEPTION)  std::abort()
+#ifndef EASYPB_NO_EXCEPTIONS
+#define EASYPB_NO_EXCEPTIONS
+#endif
+#endif
 
 
 namespace easypb
@@ -45,6 +102,199 @@ enum WireType
 };
 
 
+// Number of trailing zero bits in the non-zero value
+inline int count_trailing_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return int(index);
+#else
+    int count = 0;
+    for (; (value & 1) == 0; value >>= 1)  count++;
+    return count;
+#endif
+}
+
+// Number of leading zero bits in the non-zero value
+inline int count_leading_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - int(index);
+#else
+    int count = 0;
+    for (; (value >> 63) == 0; value <<= 1)  count++;
+    return count;
+#endif
+}
+
+// Number of bytes required to encode the value as varint, i.e. 1 + (index of the highest bit set) / 7.
+// It's computed without branches and divisions, so loops summing varint sizes can be vectorized
+inline size_t varint_size(uint64_t value)
+{
+    size_t highest_bit = 63 - count_leading_zeros(value | 1);
+    return (highest_bit * 9 + 73) / 64;
+}
+
+// varint_size() of a compile-time constant
+constexpr size_t constant_varint_size(uint64_t value)
+{
+    return value < 128? 1 : 1 + constant_varint_size(value >> 7);
+}
+
+// The longest varint encoding a value of ValueType: negative signed values are sign-extended to 64 bits,
+// while zigzag-encoded ones take no more bits than the type
+template <typename ValueType>
+constexpr size_t max_varint_size(bool zigzag = false)
+{
+    return std::is_same<ValueType, bool>::value? 1
+         : (sizeof(ValueType) <= 4  &&  (zigzag || std::is_unsigned<ValueType>::value))? 5
+         : MAX_VARINT_SIZE;
+}
+
+// Varint encoding of a compile-time constant below 2^56, as little-endian word of constant_varint_size(value) bytes
+constexpr uint64_t constant_varint_bytes(uint64_t value)
+{
+    return value < 128? value : (value & 127) | 128 | (constant_varint_bytes(value >> 7) << 8);
+}
+
+// Field tag as encoded in the message, e.g. field_tag(1, WIRETYPE_VARINT) == 8
+constexpr uint32_t field_tag(uint32_t field_num, WireType wire_type)
+{
+    return field_num * FIELDNUM_SCALE + uint32_t(wire_type);
+}
+
+// Field number known at compile time, e.g. pb.put_int32(FieldNum<1>(), x) instead of pb.put_int32(1, x).
+// Encoder writes such field tag as precomputed bytes, instead of encoding the varint at runtime
+template <uint32_t FIELD_NUM>
+using FieldNum = std::integral_constant<uint32_t, FIELD_NUM>;
+
+// Concatenate the lower 7 bits of each byte of little-endian varint bytes, loaded as a single word
+inline uint64_t gather_varint_bits(uint64_t word)
+{
+#if defined(__BMI2__)
+    return _pext_u64(word, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    word &= 0x7f7f7f7f7f7f7f7fULL;
+    word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);  // 14-bit values in 16-bit lanes
+    word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);  // 28-bit values in 32-bit lanes
+    return ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+#endif
+}
+
+// Inverse of gather_varint_bits(): spread the lower 56 bits of value into 7-bit groups, one per byte
+inline uint64_t scatter_varint_bits(uint64_t value)
+{
+#if defined(__BMI2__)
+    return _pdep_u64(value, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    value = ((value & 0x00fffffff0000000ULL) << 4) | (value & 0x000000000fffffffULL);  // 28-bit values in 32-bit lanes
+    value = ((value & 0x0fffc0000fffc000ULL) << 2) | (value & 0x00003fff00003fffULL);  // 14-bit values in 16-bit lanes
+    return ((value & 0x3f803f803f803f80ULL) << 1) | (value & 0x007f007f007f007fULL);
+#endif
+}
+
+// High bits of all bytes but the last one in varint of `size` bytes (1..8).
+// A table lookup is faster than a variable shift on many cpus
+inline uint64_t varint_continuation_bits(size_t size)
+{
+    static const uint64_t bits[9] = {0, 0, 0x80, 0x8080, 0x808080, 0x80808080, 0x8080808080ULL,
+                                     0x808080808080ULL, 0x80808080808080ULL};
+    return bits[size];
+}
+
+// Reserve space for `size` elements in containers supporting it, e.g. std::vector.
+// Repeated reservations still grow the container geometrically
+template <typename Container>
+inline auto reserve_space(Container& container, size_t size, int) -> decltype(container.reserve(size), container.capacity(), void())
+{
+    if (size > container.capacity()) {
+        container.reserve(std::max(size, 2 * container.size()));
+    }
+}
+
+// Hash tables, e.g. std::unordered_map, reserve buckets for `size` elements
+template <typename Container>
+inline auto reserve_space(Container& container, size_t size, int) -> decltype(container.reserve(size), container.bucket_count(), void())
+{
+    if (size > container.bucket_count() * container.max_load_factor()) {
+        container.reserve(std::max(size, 2 * container.size()));
+    }
+}
+
+template <typename Container>
+inline void reserve_space(Container&, size_t, long)
+{
+}
+
+template <typename Container>
+inline void reserve_space(Container& container, size_t size)
+{
+    reserve_space(container, size, 0);
+}
+
+// Insert the entry into the map, moving the key and value. The value of an existing key is replaced,
+// as required by Protobuf. C++17 maps do it by a single lookup, and older ones default-construct the value first
+template <typename Map, typename Key, typename Value>
+inline auto assign_map_entry(Map& map, Key& key, Value& value, int) -> decltype(map.insert_or_assign(std::move(key), std::move(value)), void())
+{
+    map.insert_or_assign(std::move(key), std::move(value));
+}
+
+template <typename Map, typename Key, typename Value>
+inline void assign_map_entry(Map& map, Key& key, Value& value, long)
+{
+    map[std::move(key)] = std::move(value);
+}
+
+// Reset the value to empty one, keeping the storage allocated by types supporting clear(), e.g. std::string
+template <typename T>
+inline auto clear_value(T& value, int) -> decltype(value.clear(), void())
+{
+    value.clear();
+}
+
+template <typename T>
+inline void clear_value(T& value, long)
+{
+    value = T();
+}
+
+template <typename T>
+inline void clear_value(T& value)
+{
+    clear_value(value, 0);
+}
+
+// Erase elements of the container past the first `size` ones
+template <typename Container>
+inline void truncate(Container& container, size_t size)
+{
+    if (container.size() > size) {
+        container.erase(std::next(container.begin(), size), container.end());
+    }
+}
+
+// Map signed integers to unsigned ones, so that values with small magnitude get short varint encodings
+inline uint64_t zigzag_encode(int64_t value)
+{
+    uint64_t x = value;
+    return (x << 1) ^ (- int64_t(x >> 63));
+}
+
+// Inverse of zigzag_encode()
+inline int64_t zigzag_decode(uint64_t value)
+{
+    return int64_t(value >> 1) ^ (- int64_t(value & 1));
+}
+
+
 // ****************************************************************************
 // Define the hierarchy of exceptions thrown by the library
 // ****************************************************************************
@@ -63,15 +313,52 @@ EASYPB_DEFINE_EXCEPTION(invalid_fieldnum,       exception)
 EASYPB_DEFINE_EXCEPTION(wiretype_mismatch,      exception)
 EASYPB_DEFINE_EXCEPTION(unsupported_wiretype,   exception)
 EASYPB_DEFINE_EXCEPTION(missing_required_field, exception)
+EASYPB_DEFINE_EXCEPTION(buffer_overflow,        exception)
 
 #undef EASYPB_DEFINE_EXCEPTION
 
+// Decoding errors, reported as Decoder::status in the EASYPB_NO_EXCEPTIONS mode.
+// Each one corresponds to the exception thrown otherwise
+enum DecodeStatus
+{
+    DECODE_OK = 0,
+    DECODE_UNEXPECTED_EOF,
+    DECODE_VARINT_TOO_LONG,
+    DECODE_LENGTH_TOO_LONG,
+    DECODE_INVALID_FIELDNUM,
+    DECODE_WIRETYPE_MISMATCH,
+    DECODE_UNSUPPORTED_WIRETYPE,
+    DECODE_MISSING_REQUIRED_FIELD,
+};
+
+inline const char* status_message(DecodeStatus status)
+{
+    switch (status) {
+        case DECODE_OK:                     return "OK";
+        case DECODE_UNEXPECTED_EOF:         return "Unexpected end of buffer";
+        case DECODE_VARINT_TOO_LONG:        return "More than 10 bytes in varint";
+        case DECODE_LENGTH_TOO_LONG:        return "Length-delimited field is too long";
+        case DECODE_INVALID_FIELDNUM:       return "Field tag is too large";
+        case DECODE_WIRETYPE_MISMATCH:      return "Wire type doesn't match the field type";
+        case DECODE_UNSUPPORTED_WIRETYPE:   return "Unsupported wire type";
+        case DECODE_MISSING_REQUIRED_FIELD: return "Decoded protobuf has no required field";
+    }
+    return "Unknown decoding error";
+}
+
 
 // ****************************************************************************
 // Deal with CPU endianness. Convert between the strictly little-endian
 // Protobuf wire format and native byte order of the target CPU.
 // ****************************************************************************
 
+// Check whether CPU is little-endian. If cpu has PDP byte order, or floats and ints have different order, you are screwed.
+inline bool is_little_endian()
+{
+    const uint16_t endianness = 1;
+    return *(const uint8_t *)&endianness == 1;
+}
+
 // memcpy, which also reverses byte order on big-endian cpus
 template <typename FixedType>
 inline void memcpy_LITTLE_ENDIAN(void* dest, const void* src)
@@ -79,9 +366,7 @@ inline void memcpy_LITTLE_ENDIAN(void* dest, const void* src)
     constexpr size_t size = sizeof(FixedType);
     static_assert(size==4 || size==8, "Only size==4 and size==8 are supported");
 
-    // Check whether CPU is big-endian. If cpu has PDP byte order, or floats and ints have different order, you are screwed.
-    const uint16_t endianness = 1;
-    if (*(uint8_t *)&endianness == 0) {
+    if (! is_little_endian()) {
         auto to = (char*) dest;
         auto from = (const char*) src;
         if (size == 4) {
@@ -159,189 +444,254 @@ struct string_view
 
 
 // ****************************************************************************
-// Class for encoding C++ data into the Protobuf wire format
+// Arena: monotonic allocator for decoded message trees
 // ****************************************************************************
-struct Encoder
-{
-    // Invariants:
-    //   buf_end == buffer.data() + buffer.size()
-    //   buffer.data() <= ptr <= buf_end
 
-    std::string buffer; // buffer storing the serialized data
-    char* ptr;          // the current writing point
-    char* buf_end;      // end of the allocated space
-    char* begin() const {return (char*)(buffer.data());}  // start of the allocated space
-    size_t pos()  const {return ptr - begin();}           // the current writing index
+// Memory is carved out of large blocks and freed only by the Arena destructor, all blocks at once.
+// Pass it to the Decoder (Decoder::arena) to allocate decoded strings and repeated fields of entire message tree
+// from the arena: strings decoded into easypb::string_view fields are copied into the arena,
+// and ArenaVector fields (emitted by codegen --arena) allocate their buffers in it.
+// The messages may be destroyed before or after the arena, but they can't be used once it's destroyed
+class Arena
+{
+public:
+    enum
+    {
+        FIRST_BLOCK_SIZE = 4*1024,
+        MAX_BLOCK_SIZE = 1024*1024,  // blocks grow geometrically up to this size, larger allocations get their own blocks
+    };
 
+    Arena() noexcept = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
 
-    Encoder()
+    ~Arena()
     {
-        ptr = buf_end = begin();
+        free_blocks(last_block);
+        free_blocks(spare_blocks);
     }
 
-    // Return the buffer collected by Encoder, and start from scratch
-    std::string result()
+    // Release all allocated memory at once, keeping the blocks for reuse by the next allocations.
+    // Messages allocated from the arena should be destroyed or reset first
+    void reset() noexcept
     {
-        buffer.resize(pos());
-        buffer.shrink_to_fit();
-
-        std::string temp_buffer;
-        std::swap(buffer, temp_buffer);
-        ptr = buf_end = begin();
-
-        return temp_buffer;
+        // Move the blocks into the spare list in the order of their allocation
+        while (last_block) {
+            Block* prev = last_block->prev;
+            last_block->prev = spare_blocks;
+            spare_blocks = last_block;
+            last_block = prev;
+        }
+        ptr = end = nullptr;
+        next_block_size = FIRST_BLOCK_SIZE;
+        used = 0;
     }
 
-    char* advance_ptr(ptrdiff_t bytes)
+    // Uninitialized memory for `size` bytes aligned to `alignment` (a power of 2 up to alignof(max_align_t))
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
     {
-        if (buf_end - ptr < bytes)
-        {
-            size_t old_pos = pos();
-            buffer.resize(buffer.size()*2 + bytes);
-            ptr = begin() + old_pos;
-            buf_end = begin() + buffer.size();
+        size_t padding = (0 - reinterpret_cast<uintptr_t>(ptr)) & (alignment - 1);
+        used += size;
+        if (size + padding <= size_t(end - ptr)) {
+            char* result = ptr + padding;
+            ptr = result + size;
+            return result;
         }
-        ptr += bytes;
-        return ptr - bytes;
-    }
 
+        // Large allocations get their own blocks, keeping the free space of the current block
+        if (size > MAX_BLOCK_SIZE/4) {
+            return new_block(size)->data();
+        }
+        size_t block_size = next_block_size;
+        while (block_size < size)  block_size *= 2;
+        next_block_size = std::min(2 * block_size, size_t(MAX_BLOCK_SIZE));
+        Block* block = new_block(block_size);
+        ptr = block->data() + size;
+        end = block->data() + block->size;
+        return block->data();
+    }
 
-    template <typename FixedType>
-    void write_fixed_width(FixedType value)
+    // Copy of the string owned by the arena
+    string_view copy(string_view value)
     {
-        auto old_ptr = advance_ptr(sizeof(value));
-        write_to_little_endian(old_ptr, value);
+        if (value.size() == 0)  return value;
+        char* data = static_cast<char*>(allocate(value.size(), 1));
+        std::memcpy(data, value.data(), value.size());
+        return string_view(data, value.size());
     }
 
-    void write_varint(uint64_t value)
+    size_t used_bytes() const noexcept       {return used;}
+    size_t allocated_bytes() const noexcept  {return allocated;}
+    size_t block_count() const noexcept      {return blocks;}
+
+private:
+    // Header of each block, aligned to max_align_t, so the block data start aligned too
+    struct alignas(std::max_align_t) Block
     {
-        ptr = advance_ptr(MAX_VARINT_SIZE);  // reserve enough space
+        Block* prev;
+        size_t size;
 
-#define EASYPB_STEP(n)                                                  \
-{                                                                       \
-    auto atom = value >> (n*7);                                         \
-    if (atom < 0x80) {                                                  \
-        ptr[n] = char(atom);                                            \
-        ptr += n + 1;                                                   \
-        return;                                                         \
-    } else {                                                            \
-        ptr[n] = char((atom & 0x7F) | 0x80);                            \
-    }                                                                   \
-}                                                                       \
+        char* data()  {return reinterpret_cast<char*>(this + 1);}
+    };
 
-        EASYPB_STEP(0)
-        EASYPB_STEP(1)
-        EASYPB_STEP(2)
-        EASYPB_STEP(3)
-        EASYPB_STEP(4)
-        EASYPB_STEP(5)
-        EASYPB_STEP(6)
-        EASYPB_STEP(7)
-        EASYPB_STEP(8)
-        EASYPB_STEP(9)
-#undef EASYPB_STEP
-        throw std::logic_error("Unreachable: more than 70 bits in uint64_t");
-    }
+    Block* last_block = nullptr;    // list of blocks in use, starting from the current one
+    Block* spare_blocks = nullptr;  // list of blocks released by reset()
+    char* ptr = nullptr;  // free space of the current block
+    char* end = nullptr;
+    size_t next_block_size = FIRST_BLOCK_SIZE;
+    size_t used = 0, allocated = 0, blocks = 0;
 
-    void write_varint_at(size_t varint_pos, size_t varint_size, uint64_t value)
+    // Block of at least `size` bytes: the next spare one if it's large enough, or a new one
+    Block* new_block(size_t size)
     {
-        auto write_ptr = begin() + varint_pos;
-        for (size_t i = 1; i < varint_size; ++i)
-        {
-            *write_ptr++ = char( (value & 127) | 128 );
-            value /= 128;
-        }
-        *write_ptr++ = char(value);
-
-        if (value > 127) {
-            throw length_too_long("Length requires to encode more than " + std::to_string(varint_size) + " bytes");
+        Block* block = spare_blocks;
+        if (block  &&  block->size >= size) {
+            spare_blocks = block->prev;
+        } else {
+            block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+            if (! block)  EASYPB_THROW(std::bad_alloc());
+            block->size = size;
+            allocated += size;
+            blocks++;
         }
+        block->prev = last_block;
+        last_block = block;
+        return block;
     }
 
-    void write_zigzag(int64_t value)
+    static void free_blocks(Block* block)
     {
-        uint64_t x = value;
-        write_varint((x << 1) ^ (- int64_t(x >> 63)));
+        while (block) {
+            Block* prev = block->prev;
+            std::free(block);
+            block = prev;
+        }
     }
+};
 
-    void write_bytearray(string_view value)
-    {
-        size_t len = value.size();
-        if (len > INT32_MAX) {
-            throw length_too_long("Passed byte array is too long with " + std::to_string(len) + " bytes");
-        }
+// Standard allocator drawing memory from the arena, or from the heap if it has no arena.
+// Containers propagate it on move assignment and swap, so a message tree decoded with the arena stays in the arena.
+// Copies are made on the heap (or in the arena of the assigned container), so they may outlive the source arena
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
 
-        write_varint(len);
-        auto start_ptr = advance_ptr(len);
-        std::memcpy(start_ptr, value.data(), len);
-    }
+    Arena* arena = nullptr;
 
-    void write_field_tag(uint32_t field_num, WireType wire_type)
-    {
-        write_varint(field_num*FIELDNUM_SCALE + wire_type);
-    }
+    ArenaAllocator() noexcept = default;
+    explicit ArenaAllocator(Arena* arena) noexcept : arena{arena}  {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena{other.arena}  {}
 
-    // Start a length-delimited field with yet unknown size and return its start_pos
-    size_t start_length_delimited()
+    ArenaAllocator select_on_container_copy_construction() const noexcept  {return ArenaAllocator();}
+
+    T* allocate(size_t n)
     {
-        advance_ptr(MAX_LENGTH_CODE_SIZE);
-        return pos();
+        if (arena)  return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        return std::allocator<T>().allocate(n);
     }
 
-    // Finish a length-delimited field and fill its length with now-known value
-    void commit_length_delimited(size_t start_pos)
+    void deallocate(T* p, size_t n) noexcept
     {
-        size_t field_len = pos() - start_pos;
-        write_varint_at(start_pos - MAX_LENGTH_CODE_SIZE, MAX_LENGTH_CODE_SIZE, field_len);
+        if (! arena)  std::allocator<T>().deallocate(p, n);
     }
+};
 
-    template <typename Lambda>
-    void write_length_delimited(Lambda code)
-    {
-        size_t start_pos = start_length_delimited();
-        code();
-        commit_length_delimited(start_pos);
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  {return a.arena == b.arena;}
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  {return a.arena != b.arena;}
+
+// Container for repeated fields of messages generated by codegen --arena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Switch the container to allocating from the arena, moving its elements if it has any.
+// Generated decoders call it before decoding into the container, so the elements created by the Decoder
+// go to the arena. Containers with other allocators are left intact
+template <typename Container>
+inline auto attach_arena(Container& container, Arena* arena, int) -> decltype(container.get_allocator().arena, void())
+{
+    if (container.get_allocator().arena != arena) {
+        Container moved(std::make_move_iterator(container.begin()), std::make_move_iterator(container.end()),
+                        typename Container::allocator_type(arena));
+        container = std::move(moved);
     }
+}
+
+template <typename Container>
+inline void attach_arena(Container&, Arena*, long)
+{
+}
+
+template <typename Container>
+inline void attach_arena(Container& container, Arena* arena)
+{
+    attach_arena(container, arena, 0);
+}
+
+
+// ****************************************************************************
+// put_* methods shared by Encoder and Sizer. They are expressed via
+// write_field_tag(), write_length_delimited() and the WRITER primitives
+// (write_varint, write_fixed_width, write_zigzag, write_bytearray)
+// provided by the enclosing class.
+// field_num is either an integer, or FieldNum<N>() with the tag precomputed at compile time.
+// ****************************************************************************
 
 // Define put_map* method for map<TYPE1,TYPE2>
 #define EASYPB_DEFINE_MAP_WRITER(TYPE1, TYPE2)                                \
-    template <typename FieldType>                                             \
-    void put_map_##TYPE1##_##TYPE2(uint32_t field_num, const FieldType& value)\
+    template <typename FieldNumType, typename FieldType>                      \
+    void put_map_##TYPE1##_##TYPE2(FieldNumType field_num, const FieldType& value)  \
     {                                                                         \
         for (const auto& x : value)                                           \
         {                                                                     \
-            write_field_tag(field_num, WIRETYPE_LENGTH_DELIMITED);            \
+            write_field_tag<WIRETYPE_LENGTH_DELIMITED>(field_num);            \
             write_length_delimited([&]{                                       \
-                put_##TYPE1(1, x.first);                                      \
-                put_##TYPE2(2, x.second);                                     \
+                put_##TYPE1(FieldNum<1>(), x.first);                          \
+                put_##TYPE2(FieldNum<2>(), x.second);                         \
             });                                                               \
         }                                                                     \
     }                                                                         \
 /* end of EASYPB_DEFINE_MAP_WRITER macro definition */
 
+// Define put_*_unchecked method for fixed-size TYPE, writing the field into the space reserved by reserve_fields()
+#define EASYPB_DEFINE_UNCHECKED_WRITER(TYPE, C_TYPE, WIRETYPE, WRITER)        \
+    template <typename FieldNumType>                                          \
+    void put_##TYPE##_unchecked(FieldNumType field_num, C_TYPE value)         \
+    {                                                                         \
+        write_field_tag_unchecked<WIRETYPE>(field_num);                       \
+        WRITER(value);                                                        \
+    }                                                                         \
+/* end of EASYPB_DEFINE_UNCHECKED_WRITER macro definition */
+
 // Define put_* methods for TYPE and put_map* methods for any map<TYPE,*>
-#define EASYPB_DEFINE_WRITERS(TYPE, C_TYPE, WIRETYPE, WRITER)                 \
+#define EASYPB_DEFINE_WRITERS(TYPE, C_TYPE, WIRETYPE, WRITER, PACKED_WRITER)  \
                                                                               \
-    void put_##TYPE(uint32_t field_num, C_TYPE value)                         \
+    template <typename FieldNumType>                                          \
+    void put_##TYPE(FieldNumType field_num, C_TYPE value)                     \
     {                                                                         \
-        write_field_tag(field_num, WIRETYPE);                                 \
+        write_field_tag<WIRETYPE>(field_num);                                 \
         WRITER(value);                                                        \
     }                                                                         \
                                                                               \
-    template <typename FieldType>                                             \
-    void put_repeated_##TYPE(uint32_t field_num, const FieldType& value)      \
+    template <typename FieldNumType, typename FieldType>                      \
+    void put_repeated_##TYPE(FieldNumType field_num, const FieldType& value)  \
     {                                                                         \
         for(const auto &x: value)  put_##TYPE(field_num, x);                  \
     }                                                                         \
                                                                               \
-    template <typename FieldType>                                             \
-    void put_packed_##TYPE(uint32_t field_num, const FieldType& value)        \
+    template <typename FieldNumType, typename FieldType>                      \
+    void put_packed_##TYPE(FieldNumType field_num, const FieldType& value)    \
     {                                                                         \
         static_assert(std::is_scalar<C_TYPE>() && sizeof(FieldType*),         \
             "put_packed_" #TYPE " isn't defined according to ProtoBuf format specifications");  \
                                                                               \
-        write_field_tag(field_num, WIRETYPE_LENGTH_DELIMITED);                \
-        write_length_delimited([&]{ for(const auto &x: value)  WRITER(x); }); \
+        PACKED_WRITER<C_TYPE>(field_num, value);                              \
     }                                                                         \
                                                                               \
     EASYPB_DEFINE_MAP_WRITER(TYPE, int32)                                     \
@@ -369,50 +719,727 @@ struct Encoder
     EASYPB_DEFINE_MAP_WRITER(TYPE, message)                                   \
 /* end of EASYPB_DEFINE_WRITERS macro definition*/
 
-    EASYPB_DEFINE_WRITERS(int32, int32_t, WIRETYPE_VARINT, write_varint)
-    EASYPB_DEFINE_WRITERS(int64, int64_t, WIRETYPE_VARINT, write_varint)
-    EASYPB_DEFINE_WRITERS(uint32, uint32_t, WIRETYPE_VARINT, write_varint)
-    EASYPB_DEFINE_WRITERS(uint64, uint64_t, WIRETYPE_VARINT, write_varint)
+// Define put_* methods for all field types
+#define EASYPB_DEFINE_ALL_WRITERS                                             \
+    EASYPB_DEFINE_WRITERS(int32, int32_t, WIRETYPE_VARINT, write_varint, write_packed_varints)      \
+    EASYPB_DEFINE_WRITERS(int64, int64_t, WIRETYPE_VARINT, write_varint, write_packed_varints)      \
+    EASYPB_DEFINE_WRITERS(uint32, uint32_t, WIRETYPE_VARINT, write_varint, write_packed_varints)    \
+    EASYPB_DEFINE_WRITERS(uint64, uint64_t, WIRETYPE_VARINT, write_varint, write_packed_varints)    \
+                                                                              \
+    EASYPB_DEFINE_WRITERS(sfixed32, int32_t, WIRETYPE_FIXED32, write_fixed_width, write_packed_fixed)  \
+    EASYPB_DEFINE_WRITERS(sfixed64, int64_t, WIRETYPE_FIXED64, write_fixed_width, write_packed_fixed)  \
+    EASYPB_DEFINE_WRITERS(fixed32, uint32_t, WIRETYPE_FIXED32, write_fixed_width, write_packed_fixed)  \
+    EASYPB_DEFINE_WRITERS(fixed64, uint64_t, WIRETYPE_FIXED64, write_fixed_width, write_packed_fixed)  \
+                                                                              \
+    EASYPB_DEFINE_WRITERS(sint32, int32_t, WIRETYPE_VARINT, write_zigzag, write_packed_zigzag)     \
+    EASYPB_DEFINE_WRITERS(sint64, int64_t, WIRETYPE_VARINT, write_zigzag, write_packed_zigzag)     \
+                                                                              \
+    EASYPB_DEFINE_WRITERS(bool, bool, WIRETYPE_VARINT, write_varint, write_packed_varints)          \
+    EASYPB_DEFINE_WRITERS(enum, int32_t, WIRETYPE_VARINT, write_varint, write_packed_varints)       \
+                                                                              \
+    EASYPB_DEFINE_WRITERS(float, float, WIRETYPE_FIXED32, write_fixed_width, write_packed_fixed)    \
+    EASYPB_DEFINE_WRITERS(double, double, WIRETYPE_FIXED64, write_fixed_width, write_packed_fixed)  \
+                                                                              \
+    EASYPB_DEFINE_WRITERS(string, string_view, WIRETYPE_LENGTH_DELIMITED, write_bytearray, write_packed_varints)  \
+    EASYPB_DEFINE_WRITERS(bytes, string_view, WIRETYPE_LENGTH_DELIMITED, write_bytearray, write_packed_varints)   \
+                                                                              \
+    EASYPB_DEFINE_UNCHECKED_WRITER(int32, int32_t, WIRETYPE_VARINT, write_varint_unchecked)         \
+    EASYPB_DEFINE_UNCHECKED_WRITER(int64, int64_t, WIRETYPE_VARINT, write_varint_unchecked)         \
+    EASYPB_DEFINE_UNCHECKED_WRITER(uint32, uint32_t, WIRETYPE_VARINT, write_varint_unchecked)       \
+    EASYPB_DEFINE_UNCHECKED_WRITER(uint64, uint64_t, WIRETYPE_VARINT, write_varint_unchecked)       \
+    EASYPB_DEFINE_UNCHECKED_WRITER(sfixed32, int32_t, WIRETYPE_FIXED32, write_fixed_width_unchecked)  \
+    EASYPB_DEFINE_UNCHECKED_WRITER(sfixed64, int64_t, WIRETYPE_FIXED64, write_fixed_width_unchecked)  \
+    EASYPB_DEFINE_UNCHECKED_WRITER(fixed32, uint32_t, WIRETYPE_FIXED32, write_fixed_width_unchecked)  \
+    EASYPB_DEFINE_UNCHECKED_WRITER(fixed64, uint64_t, WIRETYPE_FIXED64, write_fixed_width_unchecked)  \
+    EASYPB_DEFINE_UNCHECKED_WRITER(sint32, int32_t, WIRETYPE_VARINT, write_zigzag_unchecked)        \
+    EASYPB_DEFINE_UNCHECKED_WRITER(sint64, int64_t, WIRETYPE_VARINT, write_zigzag_unchecked)        \
+    EASYPB_DEFINE_UNCHECKED_WRITER(bool, bool, WIRETYPE_VARINT, write_varint_unchecked)             \
+    EASYPB_DEFINE_UNCHECKED_WRITER(enum, int32_t, WIRETYPE_VARINT, write_varint_unchecked)          \
+    EASYPB_DEFINE_UNCHECKED_WRITER(float, float, WIRETYPE_FIXED32, write_fixed_width_unchecked)     \
+    EASYPB_DEFINE_UNCHECKED_WRITER(double, double, WIRETYPE_FIXED64, write_fixed_width_unchecked)   \
+                                                                              \
+    /* Packed writers, called by put_packed_* methods */                      \
+    template <typename ValueType, typename FieldNumType, typename FieldType>  \
+    void write_packed_varints(FieldNumType field_num, const FieldType& value) \
+    {                                                                         \
+        write_field_tag<WIRETYPE_LENGTH_DELIMITED>(field_num);                \
+        write_varint_array<ValueType>(value, [](ValueType x) {return uint64_t(x);}, max_varint_size<ValueType>());  \
+    }                                                                         \
+                                                                              \
+    template <typename ValueType, typename FieldNumType, typename FieldType>  \
+    void write_packed_zigzag(FieldNumType field_num, const FieldType& value)  \
+    {                                                                         \
+        write_field_tag<WIRETYPE_LENGTH_DELIMITED>(field_num);                \
+        write_varint_array<ValueType>(value, [](ValueType x) {return zigzag_encode(x);}, max_varint_size<ValueType>(true));  \
+    }                                                                         \
+                                                                              \
+    /* The exact length is known beforehand, so it's written as is, without reserving space for lengths */  \
+    template <typename ValueType, typename FieldNumType, typename FieldType>  \
+    void write_packed_fixed(FieldNumType field_num, const FieldType& value)   \
+    {                                                                         \
+        size_t len = value.size() * sizeof(ValueType);                        \
+        if (len > INT32_MAX) {                                                \
+            EASYPB_THROW(length_too_long("Packed field is too long with " + std::to_string(len) + " bytes"));  \
+        }                                                                     \
+        write_field_tag<WIRETYPE_LENGTH_DELIMITED>(field_num);                \
+        write_varint(len);                                                    \
+        write_fixed_array<ValueType>(value);                                  \
+    }                                                                         \
+                                                                              \
+    template <typename FieldNumType, typename FieldType>                      \
+    void put_message(FieldNumType field_num, const FieldType& value)          \
+    {                                                                         \
+        write_field_tag<WIRETYPE_LENGTH_DELIMITED>(field_num);                \
+        write_length_delimited([&]{ encode(*this, value); });                 \
+    }                                                                         \
+                                                                              \
+    template <typename FieldNumType, typename FieldType>                      \
+    void put_repeated_message(FieldNumType field_num, const FieldType& value) \
+    {                                                                         \
+        for(const auto &x: value)  put_message(field_num, x);                 \
+    }                                                                         \
+/* end of EASYPB_DEFINE_ALL_WRITERS macro definition*/
 
-    EASYPB_DEFINE_WRITERS(sfixed32, int32_t, WIRETYPE_FIXED32, write_fixed_width)
-    EASYPB_DEFINE_WRITERS(sfixed64, int64_t, WIRETYPE_FIXED64, write_fixed_width)
-    EASYPB_DEFINE_WRITERS(fixed32, uint32_t, WIRETYPE_FIXED32, write_fixed_width)
-    EASYPB_DEFINE_WRITERS(fixed64, uint64_t, WIRETYPE_FIXED64, write_fixed_width)
 
-    EASYPB_DEFINE_WRITERS(sint32, int32_t, WIRETYPE_VARINT, write_zigzag)
-    EASYPB_DEFINE_WRITERS(sint64, int64_t, WIRETYPE_VARINT, write_zigzag)
 
-    EASYPB_DEFINE_WRITERS(bool, bool, WIRETYPE_VARINT, write_varint)
-    EASYPB_DEFINE_WRITERS(enum, int32_t, WIRETYPE_VARINT, write_varint)
+// ****************************************************************************
+// Class for encoding C++ data into the Protobuf wire format
+// ****************************************************************************
 
-    EASYPB_DEFINE_WRITERS(float, float, WIRETYPE_FIXED32, write_fixed_width)
-    EASYPB_DEFINE_WRITERS(double, double, WIRETYPE_FIXED64, write_fixed_width)
+// Receiver of encoded data produced by a streaming Encoder, called with consecutive chunks of the stream
+using Sink = std::function<void(const char* data, size_t size)>;
 
-    EASYPB_DEFINE_WRITERS(string, string_view, WIRETYPE_LENGTH_DELIMITED, write_bytearray)
-    EASYPB_DEFINE_WRITERS(bytes, string_view, WIRETYPE_LENGTH_DELIMITED, write_bytearray)
+// Sink writing into std::ostream or any other object with the write(const char*, size) method
+template <typename Stream>
+inline Sink stream_sink(Stream& stream)
+{
+    return [&stream](const char* data, size_t size) {stream.write(data, size);};
+}
 
-#undef EASYPB_DEFINE_MAP_WRITER
-#undef EASYPB_DEFINE_WRITERS
+struct Encoder
+{
+    // Invariants:
+    //   buf_begin <= ptr <= buf_end
+    //   unless the memory is external, [buf_begin, buf_end) is a heap block owned by the Encoder, or all three are nullptr
+    //   window_pos == 0, unless the Encoder has a sink or is segmented
+
+    char* buf_begin = nullptr;  // start of the allocated space
+    char* ptr = nullptr;        // the current writing point
+    char* buf_end = nullptr;    // end of the allocated space
+    bool external = false;      // the space is supplied by the caller and can't grow
+    char* begin() const {return buf_begin;}               // start of the allocated space
+    size_t pos()  const {return window_pos + (ptr - begin());}  // the current writing index in the entire stream
+    size_t window_pos = 0;  // stream position of buf_begin, i.e. the number of bytes passed to the sink or stored in previous segments
+
+    // Streaming mode: when the buffer is full, its data are passed to the sink and the space is reused.
+    // Bytes starting with the length prefix of the outermost uncommitted length-delimited field
+    // (pinned_pos) stay in the buffer, since the prefix will be back-patched later.
+    Sink sink;
+    size_t open_fields = 0;  // the number of started, but not yet committed length-delimited fields with back-patched length
+    size_t pinned_pos = 0;   // stream position of the outermost of these fields
+
+    // Segmented mode: the data are stored in a list of blocks, which never move once written.
+    // [buf_begin, buf_end) is the block segment_list[current_segment].
+    struct Segment
+    {
+        char* data;       // start of the block
+        size_t capacity;  // allocated size of the block
+        size_t size;      // the number of bytes stored in the block, if it precedes the current one
+    };
+    std::vector<Segment> segment_list;
+    size_t current_segment = 0;
+    size_t segment_size = 0;  // non-zero in the segmented mode: the minimum capacity of a new block
+
+    // Lengths of length-delimited fields in the order of their encoding, precomputed by Sizer.
+    // When set, length prefixes are written in the minimal number of bytes,
+    // otherwise they are reserved as MAX_LENGTH_CODE_SIZE bytes and back-patched.
+    const uint32_t* lengths = nullptr;
+
+    // Fused reservation: reserve_fields() ensures space for a run of fields written by put_*_unchecked() methods.
+    // When the rest of external memory is smaller, the fields are written into the scratch space,
+    // and commit_fields() copies them, so buffer_overflow is thrown only if they don't fit indeed.
+    std::vector<char> scratch;
+    char* saved_ptr = nullptr;  // ptr and buf_end of external memory, while the fields are written into the scratch space
+    char* saved_end = nullptr;
+
+
+    Encoder() noexcept
+    {
+    }
 
-    template <typename FieldType>
-    void put_message(uint32_t field_num, const FieldType& value)
+    // Write into the caller-supplied memory, throwing buffer_overflow when it's exhausted.
+    // The Encoder keeps the raw pointer, so don't free/move the memory till the encoding is finished.
+    explicit Encoder(char* data, size_t size) noexcept
     {
-        write_field_tag(field_num, WIRETYPE_LENGTH_DELIMITED);
-        write_length_delimited([&]{ encode(*this, value); });
+        buf_begin = ptr = data;
+        buf_end = data + size;
+        external = true;
     }
 
-    template <typename FieldType>
-    void put_repeated_message(uint32_t field_num, const FieldType& value)
+    // Pass encoded data to the sink in chunks of about chunk_size bytes.
+    // Call flush() after encoding the last message.
+    explicit Encoder(Sink output, size_t chunk_size = 64*1024)
+        : sink(std::move(output))
     {
-        for(const auto &x: value)  put_message(field_num, x);
+        grow(ptrdiff_t(chunk_size));
     }
-};
 
+    // Store the data in a list of blocks of about segment_size bytes, which never move once written.
+    // Get the encoded data with segments().
+    static Encoder segmented(size_t segment_size = 64*1024)
+    {
+        Encoder pb;
+        pb.segment_size = segment_size;
+        pb.next_segment(0);
+        return pb;
+    }
 
-// Message customization protocol:
-//   void encode(Encoder&, const T&);
-// The call below is intentionally unqualified, so argument-dependent lookup
-// finds an overload beside T or in namespace easypb.
+    // The Encoder owns its buffer, so it can be moved, but not copied
+    Encoder(Encoder&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Encoder& operator=(Encoder&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            buf_begin = other.buf_begin;
+            ptr = other.ptr;
+            buf_end = other.buf_end;
+            external = other.external;
+            lengths = other.lengths;
+            sink = std::move(other.sink);
+            window_pos = other.window_pos;
+            open_fields = other.open_fields;
+            pinned_pos = other.pinned_pos;
+            segment_list = std::move(other.segment_list);
+            current_segment = other.current_segment;
+            segment_size = other.segment_size;
+            scratch = std::move(other.scratch);
+            saved_ptr = other.saved_ptr;
+            saved_end = other.saved_end;
+            other.buf_begin = other.ptr = other.buf_end = nullptr;
+            other.external = false;
+            other.lengths = nullptr;
+            other.sink = nullptr;
+            other.window_pos = other.open_fields = 0;
+            other.segment_list.clear();
+            other.current_segment = other.segment_size = 0;
+            other.scratch.clear();
+            other.saved_ptr = other.saved_end = nullptr;
+        }
+        return *this;
+    }
+
+    Encoder(const Encoder&) = delete;
+    Encoder& operator=(const Encoder&) = delete;
+
+    ~Encoder()
+    {
+        release();
+    }
+
+    // Encoded data, valid till the next write into the Encoder.
+    // In the streaming mode, only the data not yet passed to the sink, and in the segmented mode, only the current block.
+    string_view view() const
+    {
+        return string_view(begin(), ptr - begin());
+    }
+
+    // Encoded data as a list of contiguous pieces, e.g. for writev().
+    // Only the segmented mode may return more than one piece.
+    std::vector<string_view> segments() const
+    {
+        std::vector<string_view> pieces;
+        for (size_t i = 0; i < current_segment; i++) {
+            if (segment_list[i].size) {
+                pieces.push_back(string_view(segment_list[i].data, segment_list[i].size));
+            }
+        }
+        if (ptr > begin()) {
+            pieces.push_back(view());
+        }
+        return pieces;
+    }
+
+    // Discard the encoded data, but keep the allocated space for encoding more messages
+    void reset()
+    {
+        // Drop the unfinished reservation redirected into the scratch space
+        if (saved_ptr) {
+            buf_end = saved_end;
+            saved_ptr = saved_end = nullptr;
+        }
+        if (current_segment) {
+            current_segment = 0;
+            buf_begin = segment_list[0].data;
+            buf_end = buf_begin + segment_list[0].capacity;
+        }
+        ptr = begin();
+        lengths = nullptr;
+        window_pos = open_fields = 0;
+    }
+
+    // Pass all encoded data to the sink
+    void flush()
+    {
+        if (open_fields) {
+            EASYPB_THROW(std::logic_error("Can't flush the Encoder inside of a length-delimited field"));
+        }
+        flush_until(pos());
+    }
+
+    // Pass the encoded data preceding the stream position `limit` to the sink,
+    // and move the remaining data to the buffer start
+    void flush_until(size_t limit)
+    {
+        size_t len = limit - window_pos;
+        if (len == 0)  return;
+
+        sink(begin(), len);
+
+        size_t rest = (ptr - begin()) - len;
+        std::memmove(begin(), begin() + len, rest);
+        ptr = begin() + rest;
+        window_pos = limit;
+    }
+
+    // Return the buffer collected by Encoder, and start from scratch
+    std::string result()
+    {
+        std::string temp_buffer;
+        for (auto piece: segments()) {
+            temp_buffer.append(piece.data(), piece.size());
+        }
+
+        if (external) {
+            reset();
+        } else {
+            release();
+        }
+        return temp_buffer;
+    }
+
+    // Free the owned buffer
+    void release() noexcept
+    {
+        if (segment_size) {
+            for (auto& segment: segment_list) {
+                std::free(segment.data);
+            }
+            segment_list.clear();
+            current_segment = 0;
+            buf_begin = ptr = buf_end = nullptr;
+        } else if (! external) {
+            std::free(buf_begin);
+            buf_begin = ptr = buf_end = nullptr;
+        }
+        lengths = nullptr;
+        window_pos = open_fields = 0;
+    }
+
+    // Ensure that at least `bytes` bytes can be written starting at ptr
+    void reserve(ptrdiff_t bytes)
+    {
+        if (buf_end - ptr < bytes)  grow(bytes);
+    }
+
+    // Ensure space for a run of fields of at most `bytes` bytes, written by put_*_unchecked() methods.
+    // Call commit_fields() after the run
+    void reserve_fields(size_t bytes)
+    {
+        if (buf_end - ptr >= ptrdiff_t(bytes))  return;
+        if (! external) {
+            grow(ptrdiff_t(bytes));
+            return;
+        }
+
+        if (scratch.size() < bytes)  scratch.resize(bytes);
+        saved_ptr = ptr;
+        saved_end = buf_end;
+        ptr = scratch.data();
+        buf_end = ptr + bytes;
+    }
+
+    // Finish the run of fields started by reserve_fields()
+    void commit_fields()
+    {
+        if (! saved_ptr)  return;
+
+        size_t len = ptr - scratch.data();
+        ptr = saved_ptr;
+        buf_end = saved_end;
+        saved_ptr = saved_end = nullptr;
+        write_raw(scratch.data(), len);
+    }
+
+    // Slow path of reserve(). Unlike std::string::resize, realloc() doesn't zero-fill the new space,
+    // and it may extend the block in place instead of copying its contents.
+    void grow(ptrdiff_t bytes)
+    {
+        if (external) {
+            EASYPB_THROW(buffer_overflow("Encoded data exceed the supplied buffer of " + std::to_string(buf_end - buf_begin) + " bytes"));
+        }
+
+        if (segment_size) {
+            next_segment(bytes);
+            return;
+        }
+
+        if (sink) {
+            // Free the space by passing to the sink everything that will not be back-patched
+            flush_until(open_fields? pinned_pos : pos());
+            if (buf_end - ptr >= bytes)  return;
+        }
+
+        size_t old_size = ptr - begin();
+        size_t new_size = size_t(buf_end - buf_begin)*2 + bytes;
+        char* new_begin = (char*) std::realloc(buf_begin, new_size);
+        if (! new_begin)  EASYPB_THROW(std::bad_alloc());
+
+        buf_begin = new_begin;
+        ptr = buf_begin + old_size;
+        buf_end = buf_begin + new_size;
+    }
+
+    // Close the current block and continue writing into the next one, allocating it if necessary
+    void next_segment(ptrdiff_t bytes)
+    {
+        if (! segment_list.empty()) {
+            segment_list[current_segment].size = ptr - begin();
+            window_pos += ptr - begin();
+            current_segment++;
+        }
+
+        if (current_segment == segment_list.size() || segment_list[current_segment].capacity < size_t(bytes)) {
+            size_t capacity = (segment_size > size_t(bytes)? segment_size : size_t(bytes));
+            segment_list.reserve(segment_list.size() + 1);
+            char* data = (char*) std::malloc(capacity);
+            if (! data)  EASYPB_THROW(std::bad_alloc());
+            segment_list.insert(segment_list.begin() + current_segment, Segment{data, capacity, 0});
+        }
+
+        buf_begin = ptr = segment_list[current_segment].data;
+        buf_end = buf_begin + segment_list[current_segment].capacity;
+    }
+
+    // Address of the byte at the stream position stream_pos, which is still kept by the Encoder
+    char* stream_ptr(size_t stream_pos)
+    {
+        size_t segment_pos = window_pos;
+        for (size_t i = current_segment; stream_pos < segment_pos; ) {
+            i--;
+            segment_pos -= segment_list[i].size;
+            if (stream_pos >= segment_pos)  return segment_list[i].data + (stream_pos - segment_pos);
+        }
+        return begin() + (stream_pos - window_pos);
+    }
+
+    char* advance_ptr(ptrdiff_t bytes)
+    {
+        reserve(bytes);
+        ptr += bytes;
+        return ptr - bytes;
+    }
+
+
+    template <typename FixedType>
+    void write_fixed_width(FixedType value)
+    {
+        auto old_ptr = advance_ptr(sizeof(value));
+        write_to_little_endian(old_ptr, value);
+    }
+
+    void write_varint(uint64_t value)
+    {
+        // Reserve enough space, but don't grow the buffer when the exact varint size fits into it
+        if (buf_end - ptr < MAX_VARINT_SIZE) {
+            reserve(varint_size(value));
+        }
+        write_varint_unchecked(value);
+    }
+
+    // Write varint into the space already reserved
+    void write_varint_unchecked(uint64_t value)
+    {
+        ptr = write_varint_to(ptr, value);
+    }
+
+    void write_zigzag_unchecked(int64_t value)
+    {
+        write_varint_unchecked(zigzag_encode(value));
+    }
+
+    template <typename FixedType>
+    void write_fixed_width_unchecked(FixedType value)
+    {
+        char* p = ptr;
+        ptr = p + sizeof(value);
+        write_to_little_endian(p, value);
+    }
+
+    // Write varint at the pointer p, returning the pointer past it.
+    // Bulk writers keep the pointer in a local variable, since stores via char* may alias the ptr member
+    EASYPB_FORCE_INLINE static char* write_varint_to(char* p, uint64_t value)
+    {
+#define EASYPB_STEP(n)                                                  \
+{                                                                       \
+    auto atom = value >> (n*7);                                         \
+    if (atom < 0x80) {                                                  \
+        p[n] = char(atom);                                              \
+        return p + n + 1;                                               \
+    } else {                                                            \
+        p[n] = char((atom & 0x7F) | 0x80);                              \
+    }                                                                   \
+}                                                                       \
+
+        EASYPB_STEP(0)
+        EASYPB_STEP(1)
+        EASYPB_STEP(2)
+        EASYPB_STEP(3)
+        EASYPB_STEP(4)
+        EASYPB_STEP(5)
+        EASYPB_STEP(6)
+        EASYPB_STEP(7)
+        EASYPB_STEP(8)
+        EASYPB_STEP(9)
+#undef EASYPB_STEP
+        EASYPB_THROW(std::logic_error("Unreachable: more than 70 bits in uint64_t"));
+    }
+
+    void write_varint_at(size_t varint_pos, size_t varint_size, uint64_t value)
+    {
+        auto write_ptr = stream_ptr(varint_pos);
+        for (size_t i = 1; i < varint_size; ++i)
+        {
+            *write_ptr++ = char( (value & 127) | 128 );
+            value /= 128;
+        }
+        *write_ptr++ = char(value);
+
+        if (value > 127) {
+            EASYPB_THROW(length_too_long("Length requires to encode more than " + std::to_string(varint_size) + " bytes"));
+        }
+    }
+
+    void write_zigzag(int64_t value)
+    {
+        write_varint(zigzag_encode(value));
+    }
+
+    void write_bytearray(string_view value)
+    {
+        size_t len = value.size();
+        if (len > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Passed byte array is too long with " + std::to_string(len) + " bytes"));
+        }
+
+        write_varint(len);
+        write_raw(value.data(), len);
+    }
+
+    // Copy the bytes as is; in the segmented and streaming modes they may be split between blocks or sink calls
+    void write_raw(const char* data, size_t len)
+    {
+        if (segment_size || sink) {
+            while (size_t(buf_end - ptr) < len) {
+                size_t part = buf_end - ptr;
+                if (part)  std::memcpy(ptr, data, part);
+                ptr += part;  data += part;  len -= part;
+                if (segment_size)  next_segment(1);
+                else  grow(1);
+            }
+        }
+
+        auto start_ptr = advance_ptr(len);
+        std::memcpy(start_ptr, data, len);
+    }
+
+    // Write all values of the container as varints of at most max_size bytes, preceded by their exact total length.
+    // They are written in a single pass after the slot for the longest possible length,
+    // and if the length turns out shorter, moved back over the spare bytes of the slot
+    template <typename ValueType, typename FieldType, typename Convert>
+    void write_varint_array(const FieldType& value, Convert convert, size_t max_size)
+    {
+        size_t max_len = value.size() * max_size;
+        size_t slot_size = varint_size(max_len);
+        size_t room = slot_size + max_len + 8;  // the last varint is stored as an 8-byte word
+
+        if (size_t(buf_end - ptr) < room  &&  (external || segment_size || sink)) {
+            // Don't exceed the supplied buffer, the segment or the sink window for the entire array:
+            // compute the length by a separate pass, then write the varints in blocks
+            size_t len = 0;
+            for(const auto &x: value)  len += varint_size(convert(ValueType(x)));
+            check_packed_length(len);
+            write_varint(len);
+            write_varints<ValueType>(value, convert);
+            return;
+        }
+
+        reserve(ptrdiff_t(room));
+        char* start = ptr + slot_size;
+        char* p = start;
+        for(const auto &x: value)  p = write_short_varint_to(p, convert(ValueType(x)));
+
+        size_t len = p - start;
+        check_packed_length(len);
+        size_t len_size = varint_size(len);
+        if (len_size < slot_size)  std::memmove(ptr + len_size, start, len);
+        ptr = write_varint_to(ptr, len) + len;
+    }
+
+    static void check_packed_length(size_t len)
+    {
+        if (len > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Packed field is too long with " + std::to_string(len) + " bytes"));
+        }
+    }
+
+    // Write varint at the pointer p having at least MAX_VARINT_SIZE bytes of space, returning the pointer past it.
+    // Values below 2^56 are written without branches, as a single 8-byte word of 7-bit groups with continuation bits
+    EASYPB_FORCE_INLINE static char* write_short_varint_to(char* p, uint64_t value)
+    {
+        if (value >= (uint64_t(1) << 56)  ||  ! is_little_endian())  return write_varint_to(p, value);
+
+        size_t size = varint_size(value);
+        uint64_t word = scatter_varint_bits(value) | varint_continuation_bits(size);
+        std::memcpy(p, &word, 8);
+        return p + size;
+    }
+
+    // Write all values of the container as varints by the branchless stores.
+    // Space is reserved for blocks of varints, which are then written without bound checks
+    template <typename ValueType, typename FieldType, typename Convert>
+    void write_varints(const FieldType& value, Convert convert)
+    {
+        char* p = ptr;
+        ptrdiff_t room = 0;  // the number of varints surely fitting into the reserved space
+        for(const auto &x: value) {
+            if (room == 0) {
+                ptr = p;
+                if (! external  &&  ! segment_size)  reserve(64 * MAX_VARINT_SIZE);
+                p = ptr;
+                room = (buf_end - p) / MAX_VARINT_SIZE;
+                if (room == 0) {
+                    // The end of external buffer or segment: check and write varints one by one
+                    write_varint(convert(ValueType(x)));
+                    p = ptr;
+                    continue;
+                }
+            }
+            p = write_short_varint_to(p, convert(ValueType(x)));
+            room--;
+        }
+        ptr = p;
+    }
+
+    // Write all values of the container as fixed-width ValueType.
+    // Contiguous containers of ValueType are copied at once on little-endian cpus
+    template <typename ValueType, typename FieldType>
+    auto write_fixed_array(const FieldType& value)
+        -> typename std::enable_if<std::is_same<typename FieldType::value_type, ValueType>::value, decltype(value.data(), void())>::type
+    {
+        // data() of an empty container may be null, that memcpy doesn't allow
+        if (is_little_endian()  &&  ! value.empty()) {
+            write_raw((const char*) value.data(), value.size() * sizeof(ValueType));
+        } else {
+            for(const auto &x: value)  write_fixed_width(x);
+        }
+    }
+
+    template <typename ValueType, typename FieldType, typename... Unused>
+    void write_fixed_array(const FieldType& value, Unused...)
+    {
+        for(const auto &x: value)  write_fixed_width(ValueType(x));
+    }
+
+    void write_field_tag(uint32_t field_num, WireType wire_type)
+    {
+        write_varint(field_num*FIELDNUM_SCALE + wire_type);
+    }
+
+    template <WireType WIRETYPE>
+    void write_field_tag(uint32_t field_num)
+    {
+        write_field_tag(field_num, WIRETYPE);
+    }
+
+    // The tag of field number known at compile time is precomputed,
+    // so it's written by a single store of 1..5 constant bytes
+    template <WireType WIRETYPE, uint32_t FIELD_NUM>
+    EASYPB_FORCE_INLINE void write_field_tag(FieldNum<FIELD_NUM> field_num)
+    {
+        if (buf_end - ptr < MAX_VARINT_SIZE) {
+            reserve(constant_varint_size(field_tag(FIELD_NUM, WIRETYPE)));
+        }
+        write_field_tag_unchecked<WIRETYPE>(field_num);
+    }
+
+    template <WireType WIRETYPE>
+    void write_field_tag_unchecked(uint32_t field_num)
+    {
+        write_varint_unchecked(field_tag(field_num, WIRETYPE));
+    }
+
+    template <WireType WIRETYPE, uint32_t FIELD_NUM>
+    EASYPB_FORCE_INLINE void write_field_tag_unchecked(FieldNum<FIELD_NUM>)
+    {
+        constexpr uint32_t tag = field_tag(FIELD_NUM, WIRETYPE);
+        constexpr size_t size = constant_varint_size(tag);
+        const uint64_t bytes = constant_varint_bytes(tag);
+
+        // The new pointer is computed before the store, which may alias the ptr member
+        char* p = ptr;
+        if (is_little_endian()) {
+            std::memcpy(p, &bytes, size);
+            ptr = p + size;
+        } else {
+            ptr = write_varint_to(p, tag);
+        }
+    }
+
+    // Start a length-delimited field with yet unknown size and return its start_pos
+    size_t start_length_delimited()
+    {
+        if (lengths) {
+            write_varint(*lengths++);
+        } else {
+            advance_ptr(MAX_LENGTH_CODE_SIZE);
+            if (open_fields++ == 0) {
+                pinned_pos = pos() - MAX_LENGTH_CODE_SIZE;
+            }
+        }
+        return pos();
+    }
+
+    // Finish a length-delimited field and fill its length with now-known value
+    void commit_length_delimited(size_t start_pos)
+    {
+        if (lengths)  return;  // the length was already written by start_length_delimited()
+
+        open_fields--;
+        size_t field_len = pos() - start_pos;
+        write_varint_at(start_pos - MAX_LENGTH_CODE_SIZE, MAX_LENGTH_CODE_SIZE, field_len);
+    }
+
+    template <typename Lambda>
+    void write_length_delimited(Lambda code)
+    {
+        size_t start_pos = start_length_delimited();
+        code();
+        commit_length_delimited(start_pos);
+    }
+
+    EASYPB_DEFINE_ALL_WRITERS
+};
+
+
+// Message customization protocol:
+//   void encode(Encoder&, const T&);
+// The call below is intentionally unqualified, so argument-dependent lookup
+// finds an overload beside T or in namespace easypb.
 template <typename MessageType>
 inline std::string encode(const MessageType& msg)
 {
@@ -421,12 +1448,200 @@ inline std::string encode(const MessageType& msg)
     return pb.result();
 }
 
+// Encode the message into the caller-supplied memory and return the number of bytes written.
+// Throws buffer_overflow if the encoded message doesn't fit.
+template <typename MessageType>
+inline size_t encode(const MessageType& msg, char* data, size_t size)
+{
+    Encoder pb(data, size);
+    encode(pb, msg);
+    return pb.pos();
+}
+
+
+
+// ****************************************************************************
+// Class computing the exact size of C++ data encoded in the Protobuf wire format.
+// It provides the same put_* API as Encoder, but only counts bytes
+// and records the length of every length-delimited field.
+// ****************************************************************************
+struct Sizer
+{
+    size_t size = 0;                // the number of bytes counted so far
+    std::vector<uint32_t> lengths;  // lengths of length-delimited fields in the order of their encoding
+
+
+    template <typename FixedType>
+    void write_fixed_width(FixedType)
+    {
+        size += sizeof(FixedType);
+    }
+
+    template <typename ValueType, typename FieldType>
+    void write_fixed_array(const FieldType& value)
+    {
+        size += value.size() * sizeof(ValueType);
+    }
+
+    template <typename ValueType, typename FieldType, typename Convert>
+    void write_varint_array(const FieldType& value, Convert convert, size_t)
+    {
+        size_t len = 0;
+        for(const auto &x: value)  len += varint_size(convert(ValueType(x)));
+        if (len > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Packed field is too long with " + std::to_string(len) + " bytes"));
+        }
+        size += varint_size(len) + len;
+    }
+
+    void write_varint(uint64_t value)
+    {
+        size += varint_size(value);
+    }
+
+    void write_zigzag(int64_t value)
+    {
+        write_varint(zigzag_encode(value));
+    }
+
+    void write_bytearray(string_view value)
+    {
+        size_t len = value.size();
+        if (len > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Passed byte array is too long with " + std::to_string(len) + " bytes"));
+        }
+
+        size += varint_size(len) + len;
+    }
+
+    void write_raw(const char*, size_t len)
+    {
+        size += len;
+    }
+
+    void write_field_tag(uint32_t field_num, WireType wire_type)
+    {
+        write_varint(field_num*FIELDNUM_SCALE + wire_type);
+    }
+
+    template <WireType WIRETYPE>
+    void write_field_tag(uint32_t field_num)
+    {
+        write_field_tag(field_num, WIRETYPE);
+    }
+
+    template <WireType WIRETYPE, uint32_t FIELD_NUM>
+    void write_field_tag(FieldNum<FIELD_NUM>)
+    {
+        size += constant_varint_size(field_tag(FIELD_NUM, WIRETYPE));
+    }
+
+    // Sizes don't depend on the space reservation made by Encoder::reserve_fields()
+    void reserve_fields(size_t) {}
+    void commit_fields() {}
+
+    template <WireType WIRETYPE, typename FieldNumType>
+    void write_field_tag_unchecked(FieldNumType field_num)
+    {
+        write_field_tag<WIRETYPE>(field_num);
+    }
+
+    template <typename FixedType>
+    void write_fixed_width_unchecked(FixedType value)
+    {
+        write_fixed_width(value);
+    }
+
+    void write_varint_unchecked(uint64_t value)
+    {
+        write_varint(value);
+    }
+
+    void write_zigzag_unchecked(int64_t value)
+    {
+        write_zigzag(value);
+    }
+
+    // The slot for the field length is allocated before any nested field,
+    // so lengths are stored in the same order as Encoder::start_length_delimited() is called
+    template <typename Lambda>
+    void write_length_delimited(Lambda code)
+    {
+        size_t index = lengths.size();
+        lengths.push_back(0);
+
+        size_t start_size = size;
+        code();
+        size_t field_len = size - start_size;
+
+        if (field_len > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Length-delimited field is too long with " + std::to_string(field_len) + " bytes"));
+        }
+        lengths[index] = uint32_t(field_len);
+        size += varint_size(field_len);
+    }
+
+    EASYPB_DEFINE_ALL_WRITERS
+};
+
+#undef EASYPB_DEFINE_MAP_WRITER
+#undef EASYPB_DEFINE_UNCHECKED_WRITER
+#undef EASYPB_DEFINE_WRITERS
+#undef EASYPB_DEFINE_ALL_WRITERS
+
+
+// Sizing customization protocol:
+//   void encode(Sizer&, const T&);
+// It should make the same put_* calls as encode(Encoder&, const T&).
+template <typename MessageType>
+inline size_t encoded_size(const MessageType& msg)
+{
+    Sizer sizer;
+    encode(sizer, msg);
+    return sizer.size;
+}
+
+// Encode the message into the sink, using the buffer of about chunk_size bytes.
+// Thanks to the lengths precomputed by Sizer, encoded data are passed to the sink
+// as soon as the buffer is full, so memory usage doesn't depend on the message size.
+template <typename MessageType>
+inline void encode_to_sink(const MessageType& msg, Sink sink, size_t chunk_size = 64*1024)
+{
+    Sizer sizer;
+    encode(sizer, msg);
+
+    Encoder pb(std::move(sink), chunk_size);
+    pb.lengths = sizer.lengths.data();
+    encode(pb, msg);
+    pb.flush();
+}
+
+// Encode the message with minimal-length prefixes of nested messages and packed fields.
+// It requires both encode(Encoder&, const T&) and encode(Sizer&, const T&),
+// and allocates the output buffer only once.
+template <typename MessageType>
+inline std::string encode_compact(const MessageType& msg)
+{
+    Sizer sizer;
+    encode(sizer, msg);
+
+    std::string buffer(sizer.size, '\0');
+    Encoder pb(&buffer[0], buffer.size());
+    pb.lengths = sizer.lengths.data();
+    encode(pb, msg);
+
+    if (pb.pos() != sizer.size) {
+        EASYPB_THROW(std::logic_error("Encoded message size differs from the one computed by Sizer"));
+    }
+    return buffer;
+}
+
 
 
 /*****************************************************************************
 Class for decoding C++ data from the Protobuf wire format.
 
-The Decoder class contains 3 layers:
+The BasicDecoder class template contains 3 layers:
 1) read_varint() and read_fixed_width(), grabbing basic values from an input buffer
 2) parse_*_value(), reading a field with known field's type and wiretype
 3) get_*(), providing easy-to-use API for users of this class
@@ -438,56 +1653,296 @@ template <typename MessageType>
 inline MessageType decode(string_view buffer);
 
 
-struct Decoder
+// Supplier of the data for a streaming Decoder: fills up to `size` bytes at `data`
+// and returns the number of bytes filled, or 0 at the end of the stream
+using Source = std::function<size_t(char* data, size_t size)>;
+
+// Source reading from std::istream or any other object with the read(char*, size) and gcount() methods
+template <typename Stream>
+inline Source stream_source(Stream& stream)
+{
+    return [&stream](char* data, size_t size) {stream.read(data, size);  return size_t(stream.gcount());};
+}
+
+// Input buffer of a streaming Decoder. It holds a chunk of the stream and refills it on demand,
+// growing only when the current length-delimited field doesn't fit into the buffer
+struct SourceBuffer
+{
+    Source source;
+    std::vector<char> buffer;
+    bool source_eof = false;
+
+    explicit SourceBuffer(Source input, size_t chunk_size = 64*1024)
+        : source{std::move(input)}, buffer(chunk_size > size_t(MAX_VARINT_SIZE)? chunk_size : size_t(MAX_VARINT_SIZE))
+    {
+    }
+
+    // Make at least `bytes` bytes available in [ptr, buf_end), keeping the unread data.
+    // Returns false if the stream ends earlier, but still provides everything up to its end
+    bool fill(const char*& ptr, const char*& buf_end, size_t bytes)
+    {
+        size_t rest = (ptr < buf_end? buf_end - ptr : 0);
+        if (rest > 0 && ptr != buffer.data()) {
+            std::memmove(buffer.data(), ptr, rest);
+        }
+        if (buffer.size() < bytes) {
+            buffer.resize(bytes > 2*buffer.size()? bytes : 2*buffer.size());
+        }
+
+        while (rest < bytes && ! source_eof) {
+            size_t len = source(buffer.data() + rest, buffer.size() - rest);
+            if (len == 0)  source_eof = true;
+            rest += len;
+        }
+
+        ptr = buffer.data();
+        buf_end = ptr + rest;
+        return rest >= bytes;
+    }
+};
+
+
+// Report the decoding error: raise the sticky Decoder::status in the EASYPB_NO_EXCEPTIONS mode, throw the exception otherwise.
+// In the first case, the calling code continues with some dummy value, so it should be followed by a proper return
+#ifdef EASYPB_NO_EXCEPTIONS
+#define EASYPB_DECODE_ERROR(STATUS, EXCEPTION)  fail(STATUS)
+#else
+#define EASYPB_DECODE_ERROR(STATUS, EXCEPTION)  throw EXCEPTION
+#endif
+
+// Input policies of BasicDecoder:
+//   CheckedInput: any input is decoded safely, checking each field against the end of the buffer
+//   TrustedInput: for buffers known to be valid, e.g. produced by ourselves and verified by a checksum.
+//     Only lengths of the length-delimited fields are checked, once per field, while fields inside them are read
+//     without bound checks. Corrupted data may be read up to 10 bytes beyond the end of the buffer
+struct CheckedInput
+{
+    static constexpr bool trusted = false;
+};
+
+struct TrustedInput
+{
+    static constexpr bool trusted = true;
+};
+
+
+// Field tables used by the table-driven decoders (Codegen --table-decoder).
+// Instead of a switch over field numbers, the generated decoder lists the message fields in a constant table,
+// and a single BasicDecoder::get_next_field(fields, msg) loop decodes them all.
+//
+// Field kinds that are decoded directly by the loop. All other fields (messages, repeated fields, maps
+// and strings with custom C++ types) are FIELD_CUSTOM, decoded by the BasicDecoder::table_get_* function.
+// The values are stored by bytes, so e.g. FIELD_VARINT32 suits any 32-bit integer or enum type
+enum FieldKind : uint8_t
+{
+    FIELD_VARINT32,  // int32, uint32, enum
+    FIELD_VARINT64,  // int64, uint64
+    FIELD_SINT32,
+    FIELD_SINT64,
+    FIELD_BOOL,
+    FIELD_FIXED32,   // fixed32, sfixed32
+    FIELD_FIXED64,   // fixed64, sfixed64
+    FIELD_FLOAT,
+    FIELD_DOUBLE,
+    FIELD_STRING,    // string and bytes stored in std::string
+    FIELD_CUSTOM,
+};
+
+constexpr uint32_t NO_HAS_FIELD = UINT32_MAX;  // FieldEntry::has_offset of fields without has_* flag
+
+template <typename Decoder>
+struct FieldEntry
+{
+    uint32_t tag;         // field tag with the wire type used by our Encoder
+    FieldKind kind;
+    uint32_t offset;      // offset of the field in the message
+    uint32_t has_offset;  // offset of the has_* flag, or NO_HAS_FIELD
+    void (*parse)(Decoder& pb, void* field);  // decoder of FIELD_CUSTOM field, nullptr for other kinds
+};
+
+template <typename InputPolicy>
+struct BasicDecoder
 {
     // Invariants:
-    //   ptr <= buf_end
+    //   ptr <= read_end,  buf_end <= read_end
+    //   ptr > buf_end only after a malformed field, that's reported by get_next_field() and packed field readers
 
     // The bytes between ptr and buf_end contain the not-yet-decoded remainder of the message.
+    // In the streaming mode, only the part of the remainder that was already read from the source.
     const char* ptr = nullptr;
     const char* buf_end = nullptr;
+    SourceBuffer* input = nullptr;  // non-null in the streaming mode
+
+    // End of the readable memory. The bytes between buf_end and read_end ("slop") belong to the enclosing message
+    // or to the padding supplied by the user, so varints near buf_end can be read with 8-byte loads
+    const char* read_end = nullptr;
 
     // These properties are filled by get_next_field() and make sense only till the entire field is decoded
     uint32_t field_num = UINT32_MAX;
     WireType wire_type = WIRETYPE_UNDEFINED;
 
+    // The first decoding error in the EASYPB_NO_EXCEPTIONS mode. Once it's raised, the Decoder behaves as if
+    // it reached the end of the message, so the decoding loops finish without any extra checks
+    DecodeStatus status = DECODE_OK;
+
+    // Arena receiving the decoded strings of string_view fields and the elements of ArenaVector fields,
+    // so the decoded message doesn't refer to the input buffer. Sub-decoders share it
+    Arena* arena = nullptr;
+
+    // Set by get_message() when the submessage occurs again, so its decoder merges the fields into the message
+    // decoded from the previous occurrence. Decoders generated by codegen --reuse-storage reset the fields otherwise
+    bool merging = false;
+
+    // Set in the streaming mode, including sub-decoders: the decoded data are overwritten by the next refill
+    bool streaming = false;
+
 
     // The Decoder keeps pointers into the data being decoded, so don't free/move them till the decoding is finished
-    explicit Decoder(const char* buffer, size_t size) noexcept
-        : ptr{buffer}, buf_end{buffer + size}
+    explicit BasicDecoder(const char* buffer, size_t size) noexcept
+        : ptr{buffer}, buf_end{buffer + size}, read_end{buf_end}
+    {
+    }
+
+    explicit BasicDecoder(string_view view) noexcept
+        : BasicDecoder(view.data(), view.size())
+    {
+    }
+
+    // The buffer followed by at least `padding` readable bytes, e.g. the rest of a larger buffer.
+    // With MAX_VARINT_SIZE or more padding bytes, all varints are read by the fast path of read_varint()
+    explicit BasicDecoder(const char* buffer, size_t size, size_t padding) noexcept
+        : ptr{buffer}, buf_end{buffer + size}, read_end{buf_end + padding}
     {
     }
 
-    explicit Decoder(string_view view) noexcept
-        : Decoder(view.data(), view.size())
+    explicit BasicDecoder(string_view view, size_t padding) noexcept
+        : BasicDecoder(view.data(), view.size(), padding)
     {
     }
 
     // Prohibit Decoder(std::string_view(char*)), since it creates a Decoder with an incorrect bufsize
-    explicit Decoder(const char*) = delete;
+    explicit BasicDecoder(const char*) = delete;
+
+    // Streaming Decoder, pulling the data from the input as required. Each field is kept in memory
+    // only till the next field is read, so don't keep string_views pointing to it
+    explicit BasicDecoder(SourceBuffer& source_buffer) noexcept
+        : input{&source_buffer}, streaming{true}
+    {
+        static_assert(! InputPolicy::trusted, "Streaming input can't be decoded by TrustedDecoder");
+    }
 
+    // Any Decoder converts into the checked one, so TrustedDecoder can be passed to decode(Decoder, T&)
+    template <typename OtherPolicy, typename = typename std::enable_if<! InputPolicy::trusted && OtherPolicy::trusted>::type>
+    BasicDecoder(const BasicDecoder<OtherPolicy>& other) noexcept
+        : ptr{other.ptr}, buf_end{other.buf_end}, input{other.input}, read_end{other.read_end},
+          field_num{other.field_num}, wire_type{other.wire_type}, status{other.status}, arena{other.arena},
+          merging{other.merging}, streaming{other.streaming}
+    {
+    }
+
+
+    // Raise the error status and stop the decoding. Used only in the EASYPB_NO_EXCEPTIONS mode
+    void fail(DecodeStatus error)
+    {
+        if (status == DECODE_OK)  status = error;
+        ptr = buf_end;
+        input = nullptr;
+    }
 
-    // Skip N bytes of the message
-    void advance_ptr(ptrdiff_t bytes)
+    // Was there a decoding error? Always false with exceptions, so the checks are compiled out
+    bool failed() const
     {
-        if (buf_end - ptr < bytes)  throw unexpected_eof("Unexpected end of buffer");
+#ifdef EASYPB_NO_EXCEPTIONS
+        return status != DECODE_OK;
+#else
+        return false;
+#endif
+    }
+
+    // Decoder of the length-delimited field `region` read from this one. It shares the slop, since
+    // the region is followed by the rest of this message (unless the region is a dummy returned on error)
+    BasicDecoder nested(string_view region) const
+    {
+        BasicDecoder pb(region);
+        if (! failed())  pb.read_end = read_end;
+        pb.arena = arena;
+        pb.streaming = streaming;
+        return pb;
+    }
+
+    // Fast reads of a malformed field may overrun the end of message into the slop, report it as the end of buffer
+    bool check_overrun()
+    {
+        if (ptr <= buf_end)  return false;
+        EASYPB_DECODE_ERROR(DECODE_UNEXPECTED_EOF, unexpected_eof("Unexpected end of buffer"));
+        return true;
+    }
+
+    // Pull at least `bytes` unread bytes from the streaming input, returning false if it ended earlier
+    bool fill(size_t bytes)
+    {
+        if (! input)  return false;
+        bool filled = input->fill(ptr, buf_end, bytes);
+        read_end = buf_end;
+        return filled;
+    }
+
+    // Copy the error status of the nested Decoder, e.g. one used for a submessage
+    void propagate(DecodeStatus nested_status)
+    {
+        if (nested_status != DECODE_OK)  fail(nested_status);
+    }
+
+    // Check the required field after decoding the message (name is "Message.field")
+    DecodeStatus missing_field(const char* name)
+    {
+        (void)name;
+        EASYPB_DECODE_ERROR(DECODE_MISSING_REQUIRED_FIELD,
+            missing_required_field(std::string("Decoded protobuf has no required field ") + name));
+        return status;
+    }
+
+    // Skip N bytes of the message, returning pointer to the first one
+    const char* advance_ptr(ptrdiff_t bytes)
+    {
+        if (! InputPolicy::trusted  &&  buf_end - ptr < bytes) {
+            if (! fill(bytes)) {
+                EASYPB_DECODE_ERROR(DECODE_UNEXPECTED_EOF, unexpected_eof("Unexpected end of buffer"));
+                // Zero bytes to read from instead of the missing data
+                static const char zeroes[16] = {};
+                return (bytes <= ptrdiff_t(sizeof(zeroes))? zeroes : nullptr);
+            }
+        }
         ptr += bytes;
+        return ptr - bytes;
     }
 
     // Did we reach the end of the message?
+    // In the streaming mode, only the end of the data read so far is checked, so use has_more() instead
     bool eof() const
     {
         return(ptr >= buf_end);
     }
 
+    // Is there any data left, either in the buffer or in the streaming source?
+    bool has_more()
+    {
+        return ! eof()  ||  fill(1);
+    }
+
 
     // Read any fixed-width field, with conversion from the little-endian Protobuf wire format
     template <typename FixedType>
     FixedType read_fixed_width()
     {
-        auto old_ptr = ptr;
-        advance_ptr(sizeof(FixedType));
-        return read_from_little_endian<FixedType>(old_ptr);
+        return read_from_little_endian<FixedType>(advance_ptr(sizeof(FixedType)));
+    }
+
+    // read_varint() with the inlined path for single-byte values, i.e. most field tags and small numbers
+    EASYPB_FORCE_INLINE uint64_t read_short_varint()
+    {
+        if (ptr < buf_end  &&  uint8_t(*ptr) < 128)  return uint8_t(*ptr++);
+        return read_varint();
     }
 
     // Slow version of reading variable-sized integer
@@ -497,52 +1952,259 @@ struct Decoder
         uint64_t byte;
         int shift = 0;
 
-        do {
-            if(eof())        throw unexpected_eof("Unexpected end of buffer in varint");
-            if(shift >= 64)  throw varint_too_long("More than 10 bytes in varint");
+        do {
+            if(eof())  {EASYPB_DECODE_ERROR(DECODE_UNEXPECTED_EOF, unexpected_eof("Unexpected end of buffer in varint"));  return 0;}
+            if(shift >= 64)  {EASYPB_DECODE_ERROR(DECODE_VARINT_TOO_LONG, varint_too_long("More than 10 bytes in varint"));  return 0;}
+
+            byte = *(uint8_t*)ptr;
+            value |= ((byte & 127) << shift);
+            ptr++;  shift += 7;
+        }
+        while (byte & 128);
+
+        return value;
+    }
+
+    // Fast version of reading variable-sized integer.
+    // It loads 8 bytes at once and finds the last byte of varint by its cleared high bit,
+    // instead of checking the bytes one by one
+    uint64_t read_varint()
+    {
+        if(! InputPolicy::trusted  &&  read_end - ptr < 10) {
+            fill(MAX_VARINT_SIZE);
+            if(read_end - ptr < 10)  return read_varint_slow();
+        }
+
+        // Short varints are the most common, and predictable branches handle them faster
+        auto p = (const uint8_t*)ptr;
+        if(p[0] < 128)  {ptr += 1;  return p[0];}
+        if(p[1] < 128)  {ptr += 2;  return (p[0] & 127) | (uint64_t(p[1]) << 7);}
+
+        // Trusted input is read bytewise near the end of the buffer, since it may have no room for the 8-byte load
+        if(InputPolicy::trusted  &&  read_end - ptr < 10)  return read_varint_slow();
+
+        uint64_t word = read_from_little_endian<uint64_t>(p);
+        uint64_t stop_bits = ~word & 0x8080808080808080ULL;
+        if(stop_bits) {
+            int bits = count_trailing_zeros(stop_bits) + 1;  // 8 * varint size
+            ptr += bits / 8;
+            return gather_varint_bits(word & (~uint64_t(0) >> (64 - bits)));
+        }
+
+        // 9- and 10-byte varints, e.g. negative int32/int64 values
+        uint64_t value = gather_varint_bits(word) | (uint64_t(p[8] & 127) << 56);
+        if(p[8] < 128)  {ptr += 9;  return value;}
+        value |= uint64_t(p[9]) << 63;
+        if(p[9] < 128)  {ptr += 10;  return value;}
+        EASYPB_DECODE_ERROR(DECODE_VARINT_TOO_LONG, varint_too_long("More than 10 bytes in varint"));
+        return 0;
+    }
+
+    // Read zigzag-encoded integer value
+    int64_t read_zigzag()
+    {
+        return zigzag_decode(read_varint());
+    }
+
+
+    // Number of varints in the rest of the buffer, i.e. the number of bytes with cleared high bit
+    size_t count_varints() const
+    {
+        size_t count = 0;
+        const char* p = ptr;
+        for (; buf_end - p >= 8;  p += 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            uint64_t stop_bits = (~word & 0x8080808080808080ULL) >> 7;
+            count += (stop_bits * 0x0101010101010101ULL) >> 56;  // sum of bytes
+        }
+        for (; p < buf_end;  p++) {
+            count += (uint8_t(*p) < 128);
+        }
+        return count;
+    }
+
+    // Store to counts[i] the number of fields with tags[i] in the rest of the buffer, e.g. to reserve space
+    // for repeated fields prior to decoding them. The fields are skipped without changing the Decoder state.
+    // Counting stops at malformed data, leaving their reporting to the decoding itself.
+    // In the streaming mode, only the data read so far are counted
+    template <size_t N>
+    void count_fields(const uint32_t (&tags)[N], size_t (&counts)[N]) const
+    {
+        std::fill(counts, counts + N, size_t(0));
+        const char* p = ptr;
+        while (p < buf_end) {
+            uint64_t tag, length;
+            if (! (p = scan_varint(p, &tag)))  return;
+            for (size_t i = 0; i < N; i++) {
+                counts[i] += (tag == tags[i]);
+            }
+
+            switch (tag % FIELDNUM_SCALE) {
+                case WIRETYPE_VARINT:            if (! (p = scan_varint(p, &length)))  return;  length = 0;  break;
+                case WIRETYPE_FIXED64:           length = 8;  break;
+                case WIRETYPE_FIXED32:           length = 4;  break;
+                case WIRETYPE_LENGTH_DELIMITED:  if (! (p = scan_varint(p, &length)))  return;  break;
+                default:                         return;
+            }
+            if (uint64_t(buf_end - p) < length)  return;
+            p += length;
+        }
+    }
+
+    // count_fields() for messages long enough to contain many repeated fields, and zero counts for shorter ones,
+    // since reallocation of a few short containers costs less than the scan.
+    // Generated decoders call it in the codegen --prescan-repeated mode to reserve space for repeated fields
+    template <size_t N>
+    void prescan_fields(const uint32_t (&tags)[N], size_t (&counts)[N]) const
+    {
+        if (buf_end - ptr >= EASYPB_PRESCAN_MIN_SIZE) {
+            count_fields(tags, counts);
+        } else {
+            std::fill(counts, counts + N, size_t(0));
+        }
+    }
+
+    // Read varint at p for count_fields(), returning pointer past it or nullptr if the varint is malformed
+    EASYPB_FORCE_INLINE const char* scan_varint(const char* p, uint64_t* value) const
+    {
+        if (p < buf_end  &&  uint8_t(*p) < 128)  {*value = uint8_t(*p);  return p + 1;}
+        return scan_varint_slow(p, value);
+    }
+
+    const char* scan_varint_slow(const char* p, uint64_t* value) const
+    {
+        uint64_t result = 0;
+        for (int shift = 0;  p < buf_end  &&  shift < 64;  shift += 7) {
+            uint64_t byte = uint8_t(*p++);
+            result |= (byte & 127) << shift;
+            if (byte < 128)  {*value = result;  return p;}
+        }
+        return nullptr;
+    }
+
+    // Read the rest of the buffer as packed varints
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    void read_packed_varints(RepeatedFieldType *field)
+    {
+        read_varint_array<FieldType>(field, count_varints(), [](uint64_t x) {return x;}, 0);
+    }
+
+    // Read the rest of the buffer as packed zigzag-encoded integers
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    void read_packed_zigzag(RepeatedFieldType *field)
+    {
+        read_varint_array<FieldType>(field, count_varints(), [](uint64_t x) {return ValueType(zigzag_decode(x));}, 0);
+    }
+
+// Decode the rest of the buffer as `count` varints, storing convert(varint) via STORE.
+// It loads 8 bytes at once, decodes the entire run of 1-byte varints and then the next longer varint from another word
+#define EASYPB_READ_VARINT_ARRAY(STORE)                                       \
+        const char* p = ptr;                                                  \
+        while (buf_end - p >= 8) {                                            \
+            uint64_t high_bits = read_from_little_endian<uint64_t>(p) & 0x8080808080808080ULL;  \
+            int short_varints = (high_bits? count_trailing_zeros(high_bits) / 8 : 8);  \
+            for (int i = 0; i < short_varints; i++) {                         \
+                STORE( FieldType(convert(uint8_t(p[i]))) );                   \
+            }                                                                 \
+            p += short_varints;                                               \
+            if (high_bits  &&  buf_end - p >= 8) {                            \
+                /* The longer varint is decoded as in read_varint(): 2-byte one by a branch, others from a single word */  \
+                uint64_t word = read_from_little_endian<uint64_t>(p);         \
+                uint64_t stop_bits = ~word & 0x8080808080808080ULL;           \
+                if (uint8_t(p[1]) < 128) {                                    \
+                    p += 2;                                                   \
+                    STORE( FieldType(convert((word & 127) | ((word >> 1) & 0x3f80))) );  \
+                } else if (stop_bits) {                                       \
+                    int bits = count_trailing_zeros(stop_bits) + 1;           \
+                    p += bits / 8;                                            \
+                    STORE( FieldType(convert(gather_varint_bits(word & (~uint64_t(0) >> (64 - bits))))) );  \
+                } else {                                                      \
+                    ptr = p;                                                  \
+                    uint64_t value = read_varint();                           \
+                    if (check_overrun()  ||  failed())  return;               \
+                    STORE( FieldType(convert(value)) );                       \
+                    p = ptr;                                                  \
+                }                                                             \
+            }                                                                 \
+        }                                                                     \
+        ptr = p;                                                              \
+                                                                              \
+        while (! eof()) {                                                     \
+            /* The last varint may be unterminated, so no value is stored after the error */  \
+            uint64_t value = read_varint();                                   \
+            if (check_overrun()  ||  failed())  return;                       \
+            STORE( FieldType(convert(value)) );                               \
+        }                                                                     \
+/* end of EASYPB_READ_VARINT_ARRAY macro definition */
+
+    // Contiguous container: resize it once and store the values without capacity checks.
+    // Each varint ends with exactly one byte having cleared high bit, so exactly `count` values will be stored
+    template <typename FieldType, typename RepeatedFieldType, typename Convert>
+    auto read_varint_array(RepeatedFieldType *field, size_t count, Convert convert, int)
+        -> decltype(field->resize(0), field->data(), void())
+    {
+        size_t old_size = field->size();
+        field->resize(old_size + count);
+        FieldType* values = field->data() + old_size;
+
+#define EASYPB_STORE(x)  (*values++ = (x))
+        EASYPB_READ_VARINT_ARRAY(EASYPB_STORE)
+#undef EASYPB_STORE
+    }
 
-            byte = *(uint8_t*)ptr;
-            value |= ((byte & 127) << shift);
-            ptr++;  shift += 7;
-        }
-        while (byte & 128);
+    // Other containers: reserve space if possible, and push_back the values
+    template <typename FieldType, typename RepeatedFieldType, typename Convert>
+    void read_varint_array(RepeatedFieldType *field, size_t count, Convert convert, long)
+    {
+        reserve_space(*field, field->size() + count);
 
-        return value;
+#define EASYPB_STORE(x)  field->push_back(x)
+        EASYPB_READ_VARINT_ARRAY(EASYPB_STORE)
+#undef EASYPB_STORE
     }
+#undef EASYPB_READ_VARINT_ARRAY
 
-    // Fast version of reading variable-sized integer
-    uint64_t read_varint()
+    // Read the rest of the buffer as packed fixed-width values of ValueType
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    void read_packed_fixed(RepeatedFieldType *field)
     {
-        if(buf_end - ptr < 10)  return read_varint_slow();
+        if ((buf_end - ptr) % sizeof(ValueType) != 0) {
+            EASYPB_DECODE_ERROR(DECODE_UNEXPECTED_EOF, unexpected_eof("Unexpected end of buffer"));
+            return;
+        }
+        read_fixed_array<ValueType, FieldType>(field, (buf_end - ptr) / sizeof(ValueType), 0);
+    }
 
-        auto p = (uint8_t*)ptr;
-        uint64_t value = 0;
+    // Contiguous container of ValueType: resize it once and copy the values at once on little-endian cpus
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    auto read_fixed_array(RepeatedFieldType *field, size_t count, int)
+        -> typename std::enable_if<std::is_same<FieldType, ValueType>::value, decltype(field->resize(0), field->data(), void())>::type
+    {
+        size_t old_size = field->size();
+        field->resize(old_size + count);
+        FieldType* values = field->data() + old_size;
 
-#define EASYPB_STEP(n)                                                        \
-{                                                                             \
-    value |= (uint64_t(p[n] & 127) << (n*7));                                 \
-    if(p[n] < 128)  {ptr += n + 1;  return value;}                            \
-}                                                                             \
+        if (is_little_endian()  &&  count) {
+            std::memcpy(values, advance_ptr(count * sizeof(ValueType)), count * sizeof(ValueType));
+        } else {
+            for (size_t i = 0; i < count; i++)  values[i] = read_fixed_width<ValueType>();
+        }
+    }
 
-        EASYPB_STEP(0)
-        EASYPB_STEP(1)
-        EASYPB_STEP(2)
-        EASYPB_STEP(3)
-        EASYPB_STEP(4)
-        EASYPB_STEP(5)
-        EASYPB_STEP(6)
-        EASYPB_STEP(7)
-        EASYPB_STEP(8)
-        EASYPB_STEP(9)
-#undef EASYPB_STEP
-        throw varint_too_long("More than 10 bytes in varint");
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    void read_fixed_array(RepeatedFieldType *field, size_t count, long)
+    {
+        reserve_space(*field, field->size() + count);
+        for (size_t i = 0; i < count; i++) {
+            field->push_back( FieldType(read_fixed_width<ValueType>()) );
+        }
     }
 
-    // Read zigzag-encoded integer value
-    int64_t read_zigzag()
+    // Strings and bytes can't be packed, but EASYPB_DEFINE_READERS requires some packed reader
+    template <typename ValueType, typename FieldType, typename RepeatedFieldType>
+    void read_packed_none(RepeatedFieldType*)
     {
-        uint64_t value = read_varint();
-        return (value >> 1) ^ (- int64_t(value & 1));
     }
 
 
@@ -552,8 +2214,9 @@ struct Decoder
         switch(wire_type) {
             case WIRETYPE_FIXED64:  return FloatingPointType( read_fixed_width<double>() );  // Here we can lose FP precision/range
             case WIRETYPE_FIXED32:  return FloatingPointType( read_fixed_width<float>() );
-            default:                throw wiretype_mismatch("Can't parse floating-point value with wiretype "
-                                            + std::to_string(wire_type));
+            default:                EASYPB_DECODE_ERROR(DECODE_WIRETYPE_MISMATCH,
+                                        wiretype_mismatch("Can't parse floating-point value with wiretype " + std::to_string(wire_type)));
+                                    return 0;
         }
     }
 
@@ -563,8 +2226,9 @@ struct Decoder
             case WIRETYPE_VARINT:   return read_varint();
             case WIRETYPE_FIXED64:  return read_fixed_width<uint64_t>();
             case WIRETYPE_FIXED32:  return read_fixed_width<uint32_t>();
-            default:                throw wiretype_mismatch("Can't parse integral value with wiretype "
-                                            + std::to_string(wire_type));
+            default:                EASYPB_DECODE_ERROR(DECODE_WIRETYPE_MISMATCH,
+                                        wiretype_mismatch("Can't parse integral value with wiretype " + std::to_string(wire_type)));
+                                    return 0;
         }
     }
 
@@ -574,37 +2238,182 @@ struct Decoder
             case WIRETYPE_VARINT:   return read_zigzag();
             case WIRETYPE_FIXED64:  return read_fixed_width<int64_t>();
             case WIRETYPE_FIXED32:  return read_fixed_width<int32_t>();
-            default:                throw wiretype_mismatch("Can't parse zigzag integral value with wiretype "
-                                            + std::to_string(wire_type));
+            default:                EASYPB_DECODE_ERROR(DECODE_WIRETYPE_MISMATCH,
+                                        wiretype_mismatch("Can't parse zigzag integral value with wiretype " + std::to_string(wire_type)));
+                                    return 0;
         }
     }
 
     string_view parse_bytearray_value()
     {
         if (wire_type != WIRETYPE_LENGTH_DELIMITED) {
-            throw wiretype_mismatch("Can't parse bytearray with wiretype " + std::to_string(wire_type));
+            EASYPB_DECODE_ERROR(DECODE_WIRETYPE_MISMATCH,
+                wiretype_mismatch("Can't parse bytearray with wiretype " + std::to_string(wire_type)));
+            return {"", 0};
         }
 
+        return read_bytearray();
+    }
+
+    // String or bytes value stored into a field of FieldType. Values of string_view fields are copied into the arena,
+    // if the Decoder has one, so they stay valid after the input buffer is freed (or refilled by the streaming input)
+    template <typename FieldType>
+    string_view parse_string_value()
+    {
+        string_view value = parse_bytearray_value();
+        if (std::is_same<FieldType, string_view>::value  &&  arena) {
+            return arena->copy(value);
+        }
+        return value;
+    }
+
+    // Read byte array prefixed with its length
+    string_view read_bytearray()
+    {
         uint64_t len = read_varint();
         if (len > INT32_MAX) {
-            throw length_too_long("Byte array field is too long with " + std::to_string(len) + " bytes");
+            EASYPB_DECODE_ERROR(DECODE_LENGTH_TOO_LONG,
+                length_too_long("Byte array field is too long with " + std::to_string(len) + " bytes"));
+            return {"", 0};
         }
 
-        advance_ptr(int32_t(len));
+        // Trusted input is checked here, once per length-delimited field
+        if (InputPolicy::trusted  &&  int64_t(len) > buf_end - ptr) {
+            EASYPB_DECODE_ERROR(DECODE_UNEXPECTED_EOF, unexpected_eof("Unexpected end of buffer"));
+            return {"", 0};
+        }
 
-        return {ptr-len, size_t(len)};
+        const char* data = advance_ptr(int32_t(len));
+        if (failed())  return {"", 0};
+        return {data, size_t(len)};
     }
 
 
     // Read and decode tag of the next field, and prepare to read the field value
     bool get_next_field()
     {
-        if(eof())  return false;
+        if(! has_more()) {
+            check_overrun();
+            return false;
+        }
+
+        return set_tag(read_varint());
+    }
+
+    // Table-driven version of the get_next_field() loop: decode all fields listed in the table,
+    // and stop at the next field missing in the table, returning it like get_next_field()
+    template <size_t N, typename MessageType>
+    bool get_next_field(const FieldEntry<BasicDecoder> (&fields)[N], MessageType* msg)
+    {
+        return get_next_table_field(fields, N, msg);
+    }
+
+    // The loop is shared by all messages, so the code size doesn't grow with the schema
+    bool get_next_table_field(const FieldEntry<BasicDecoder>* fields, size_t size, void* msg)
+    {
+        char* base = static_cast<char*>(msg);
+        size_t next = 0;  // fields usually go in the table order, so we predict the entry following the last decoded one
+
+        while (has_more()) {
+            uint64_t tag = read_short_varint();
+            size_t i = next;
+            if (i >= size  ||  fields[i].tag != tag) {
+                i = find_table_field(fields, size, next, tag);
+                if (i == size)  return set_tag(tag);
+            }
+
+            field_num = uint32_t(tag / FIELDNUM_SCALE);
+            wire_type = WireType(tag % FIELDNUM_SCALE);
+            if (fields[i].tag == tag) {
+                parse_table_field(fields[i], base);
+            } else {
+                convert_table_field(fields[i], base);
+            }
+            next = i + 1;
+        }
+
+        check_overrun();
+        return false;
+    }
+
+    // Search the table by the field number, so fields with unexpected wire types are decoded too.
+    // The search starts with the last decoded entry, since repeated fields usually go in a row
+    static size_t find_table_field(const FieldEntry<BasicDecoder>* fields, size_t size, size_t next, uint64_t tag)
+    {
+        size_t i = (next > 0? next - 1 : 0);
+        for (size_t count = 0; count < size; count++) {
+            if (fields[i].tag / FIELDNUM_SCALE == tag / FIELDNUM_SCALE)  return i;
+            if (++i == size)  i = 0;
+        }
+        return size;
+    }
+
+    // Store the value into the field of any type with the same size, e.g. an enum. Copying the bytes
+    // keeps the strict aliasing rules, and compiles into a single store
+    template <typename ValueType>
+    EASYPB_FORCE_INLINE static void store_table_field(char* field, ValueType value)
+    {
+        std::memcpy(field, &value, sizeof(value));
+    }
+
+    // Decode the field with the wire type implied by its kind
+    EASYPB_FORCE_INLINE void parse_table_field(const FieldEntry<BasicDecoder>& entry, char* base)
+    {
+        char* field = base + entry.offset;
+        switch (entry.kind) {
+            case FIELD_VARINT32:  store_table_field(field, uint32_t(read_short_varint()));  break;
+            case FIELD_VARINT64:  store_table_field(field, read_short_varint());  break;
+            case FIELD_SINT32:    store_table_field(field, int32_t(read_zigzag()));  break;
+            case FIELD_SINT64:    store_table_field(field, read_zigzag());  break;
+            case FIELD_BOOL:      *reinterpret_cast<bool*>(field) = (read_varint() != 0);  break;
+            case FIELD_FIXED32:   store_table_field(field, read_fixed_width<uint32_t>());  break;
+            case FIELD_FIXED64:   store_table_field(field, read_fixed_width<uint64_t>());  break;
+            case FIELD_FLOAT:     store_table_field(field, read_fixed_width<float>());  break;
+            case FIELD_DOUBLE:    store_table_field(field, read_fixed_width<double>());  break;
+            case FIELD_STRING: {
+                string_view value = read_bytearray();
+                reinterpret_cast<std::string*>(field)->assign(value.data(), value.size());
+                break;
+            }
+            case FIELD_CUSTOM:    entry.parse(*this, field);  break;
+        }
+
+        if (entry.has_offset != NO_HAS_FIELD) {
+            *reinterpret_cast<bool*>(base + entry.has_offset) = true;
+        }
+    }
+
+    // Decode the field encoded with another wire type, converting the value like get_* methods do
+    void convert_table_field(const FieldEntry<BasicDecoder>& entry, char* base)
+    {
+        char* field = base + entry.offset;
+        switch (entry.kind) {
+            case FIELD_VARINT32:
+            case FIELD_FIXED32:   store_table_field(field, uint32_t(parse_integer_value()));  break;
+            case FIELD_VARINT64:
+            case FIELD_FIXED64:   store_table_field(field, parse_integer_value());  break;
+            case FIELD_SINT32:    store_table_field(field, int32_t(parse_zigzag_value()));  break;
+            case FIELD_SINT64:    store_table_field(field, parse_zigzag_value());  break;
+            case FIELD_BOOL:      *reinterpret_cast<bool*>(field) = (parse_integer_value() != 0);  break;
+            case FIELD_FLOAT:     store_table_field(field, parse_fp_value<float>());  break;
+            case FIELD_DOUBLE:    store_table_field(field, parse_fp_value<double>());  break;
+            case FIELD_STRING:    parse_bytearray_value();  break;  // reports the wire type mismatch
+            case FIELD_CUSTOM:    entry.parse(*this, field);  break;
+        }
+
+        if (entry.has_offset != NO_HAS_FIELD) {
+            *reinterpret_cast<bool*>(base + entry.has_offset) = true;
+        }
+    }
 
-        uint64_t tag = read_varint();
+    // Decode the field tag read by get_next_field()
+    bool set_tag(uint64_t tag)
+    {
         if (tag > UINT32_MAX) {
-            throw invalid_fieldnum("Field tag is too large: " + std::to_string(tag));
+            EASYPB_DECODE_ERROR(DECODE_INVALID_FIELDNUM, invalid_fieldnum("Field tag is too large: " + std::to_string(tag)));
+            return false;
         }
+        if (failed())  return false;
 
         field_num = uint32_t(tag / FIELDNUM_SCALE);
         wire_type = WireType(tag % FIELDNUM_SCALE);
@@ -622,13 +2431,9 @@ struct Decoder
         } else if (wire_type == WIRETYPE_FIXED64) {
             advance_ptr(8);
         } else if (wire_type == WIRETYPE_LENGTH_DELIMITED) {
-            uint64_t len = read_varint();
-            if (len > INT32_MAX) {
-                throw length_too_long("Byte array field is too long with " + std::to_string(len) + " bytes");
-            }
-            advance_ptr(int32_t(len));
+            read_bytearray();
         } else {
-            throw unsupported_wiretype("Unsupported wire type " + std::to_string(wire_type));
+            EASYPB_DECODE_ERROR(DECODE_UNSUPPORTED_WIRETYPE, unsupported_wiretype("Unsupported wire type " + std::to_string(wire_type)));
         }
     }
 
@@ -638,7 +2443,7 @@ struct Decoder
     template <typename FieldType>                                             \
     void get_map_##TYPE1##_##TYPE2(FieldType *field)                          \
     {                                                                         \
-        Decoder sub_decoder(parse_bytearray_value());                         \
+        BasicDecoder sub_decoder = nested(parse_bytearray_value());           \
         bool has_key = false, has_value = false;                              \
         typename FieldType::key_type key{};                                   \
         typename FieldType::mapped_type value{};                              \
@@ -653,14 +2458,21 @@ struct Decoder
             }                                                                 \
         }                                                                     \
                                                                               \
+        propagate(sub_decoder.status);                                        \
         if (has_key && has_value) {                                           \
-            (*field)[key] = value;                                            \
+            assign_map_entry(*field, key, value, 0);                          \
         }                                                                     \
+    }                                                                         \
+                                                                              \
+    template <typename FieldType>                                             \
+    static void table_get_map_##TYPE1##_##TYPE2(BasicDecoder& pb, void* field)  \
+    {                                                                         \
+        pb.get_map_##TYPE1##_##TYPE2(static_cast<FieldType*>(field));         \
     }                                                                         \
 /* end of EASYPB_DEFINE_MAP_READER macro definition */
 
 // Define get_* methods for TYPE and get_map* methods for any map<TYPE,*>
-#define EASYPB_DEFINE_READERS(TYPE, C_TYPE, PARSER, READER)                   \
+#define EASYPB_DEFINE_READERS(TYPE, C_TYPE, PARSER, PACKED_READER)            \
                                                                               \
     C_TYPE get_##TYPE()                                                       \
     {                                                                         \
@@ -682,15 +2494,27 @@ struct Decoder
                                                                               \
         if (std::is_scalar<C_TYPE>()  &&  (wire_type == WIRETYPE_LENGTH_DELIMITED)) {  \
             /* Parsing packed repeated field */                               \
-            Decoder sub_decoder(parse_bytearray_value());                     \
-            while (! sub_decoder.eof()) {                                     \
-                field->push_back( FieldType(sub_decoder.READER()) );          \
-            }                                                                 \
+            BasicDecoder sub_decoder = nested(parse_bytearray_value());       \
+            sub_decoder.PACKED_READER<C_TYPE, FieldType>(field);              \
+            propagate(sub_decoder.status);                                    \
         } else {                                                              \
             field->push_back( FieldType(PARSER()) );                          \
         }                                                                     \
     }                                                                         \
                                                                               \
+    /* Decoders of FIELD_CUSTOM fields in the field tables */                 \
+    template <typename FieldType>                                             \
+    static void table_get_##TYPE(BasicDecoder& pb, void* field)               \
+    {                                                                         \
+        pb.get_##TYPE(static_cast<FieldType*>(field));                        \
+    }                                                                         \
+                                                                              \
+    template <typename RepeatedFieldType>                                     \
+    static void table_get_repeated_##TYPE(BasicDecoder& pb, void* field)      \
+    {                                                                         \
+        pb.get_repeated_##TYPE(static_cast<RepeatedFieldType*>(field));       \
+    }                                                                         \
+                                                                              \
     EASYPB_DEFINE_MAP_READER(TYPE, int32)                                     \
     EASYPB_DEFINE_MAP_READER(TYPE, int64)                                     \
     EASYPB_DEFINE_MAP_READER(TYPE, uint32)                                    \
@@ -716,27 +2540,27 @@ struct Decoder
     EASYPB_DEFINE_MAP_READER(TYPE, message)                                   \
 /* end of EASYPB_DEFINE_READERS macro definition */
 
-    EASYPB_DEFINE_READERS(int32, int32_t, parse_integer_value, read_varint)
-    EASYPB_DEFINE_READERS(int64, int64_t, parse_integer_value, read_varint)
-    EASYPB_DEFINE_READERS(uint32, uint32_t, parse_integer_value, read_varint)
-    EASYPB_DEFINE_READERS(uint64, uint64_t, parse_integer_value, read_varint)
+    EASYPB_DEFINE_READERS(int32, int32_t, parse_integer_value, read_packed_varints)
+    EASYPB_DEFINE_READERS(int64, int64_t, parse_integer_value, read_packed_varints)
+    EASYPB_DEFINE_READERS(uint32, uint32_t, parse_integer_value, read_packed_varints)
+    EASYPB_DEFINE_READERS(uint64, uint64_t, parse_integer_value, read_packed_varints)
 
-    EASYPB_DEFINE_READERS(sfixed32, int32_t, parse_integer_value, read_fixed_width<int32_t>)
-    EASYPB_DEFINE_READERS(sfixed64, int64_t, parse_integer_value, read_fixed_width<int64_t>)
-    EASYPB_DEFINE_READERS(fixed32, uint32_t, parse_integer_value, read_fixed_width<uint32_t>)
-    EASYPB_DEFINE_READERS(fixed64, uint64_t, parse_integer_value, read_fixed_width<uint64_t>)
+    EASYPB_DEFINE_READERS(sfixed32, int32_t, parse_integer_value, read_packed_fixed)
+    EASYPB_DEFINE_READERS(sfixed64, int64_t, parse_integer_value, read_packed_fixed)
+    EASYPB_DEFINE_READERS(fixed32, uint32_t, parse_integer_value, read_packed_fixed)
+    EASYPB_DEFINE_READERS(fixed64, uint64_t, parse_integer_value, read_packed_fixed)
 
-    EASYPB_DEFINE_READERS(sint32, int32_t, parse_zigzag_value, read_zigzag)
-    EASYPB_DEFINE_READERS(sint64, int64_t, parse_zigzag_value, read_zigzag)
+    EASYPB_DEFINE_READERS(sint32, int32_t, parse_zigzag_value, read_packed_zigzag)
+    EASYPB_DEFINE_READERS(sint64, int64_t, parse_zigzag_value, read_packed_zigzag)
 
-    EASYPB_DEFINE_READERS(bool, bool, parse_integer_value, read_varint)
-    EASYPB_DEFINE_READERS(enum, int32_t, parse_integer_value, read_varint)
+    EASYPB_DEFINE_READERS(bool, bool, parse_integer_value, read_packed_varints)
+    EASYPB_DEFINE_READERS(enum, int32_t, parse_integer_value, read_packed_varints)
 
-    EASYPB_DEFINE_READERS(float, float, parse_fp_value<FieldType>, read_fixed_width<float>)
-    EASYPB_DEFINE_READERS(double, double, parse_fp_value<FieldType>, read_fixed_width<double>)
+    EASYPB_DEFINE_READERS(float, float, parse_fp_value<FieldType>, read_packed_fixed)
+    EASYPB_DEFINE_READERS(double, double, parse_fp_value<FieldType>, read_packed_fixed)
 
-    EASYPB_DEFINE_READERS(string, string_view, parse_bytearray_value, parse_bytearray_value)
-    EASYPB_DEFINE_READERS(bytes, string_view, parse_bytearray_value, parse_bytearray_value)
+    EASYPB_DEFINE_READERS(string, string_view, parse_string_value<FieldType>, read_packed_none)
+    EASYPB_DEFINE_READERS(bytes, string_view, parse_string_value<FieldType>, read_packed_none)
 
 #undef EASYPB_DEFINE_MAP_READER
 #undef EASYPB_DEFINE_READERS
@@ -744,24 +2568,119 @@ struct Decoder
     template <typename MessageType>
     void get_message(MessageType *field, bool *has_field = nullptr)
     {
-        decode(Decoder(parse_bytearray_value()), *field);
+        BasicDecoder sub_decoder = nested(parse_bytearray_value());
+        sub_decoder.merging = (has_field && *has_field);
+        propagate(decode_message(sub_decoder, *field, 0));
         if(has_field)  *has_field = true;
     }
 
     template <typename RepeatedMessageType>
     void get_repeated_message(RepeatedMessageType *field)
     {
-        using T = typename RepeatedMessageType::value_type;
-        T value{};
-        decode(Decoder(parse_bytearray_value()), value);
-        field->push_back(std::move(value));
+        decode_new_element(nested(parse_bytearray_value()), *field, 0);
+    }
+
+    // Decode the message over the element *count of the container, reusing its storage, or into a new element
+    // if the container is shorter. Decoders generated by codegen --reuse-storage start counting from 0,
+    // and finally erase the elements left from the previous decoding
+    template <typename RepeatedMessageType>
+    void get_repeated_message(RepeatedMessageType *field, size_t *count)
+    {
+        BasicDecoder sub_decoder = nested(parse_bytearray_value());
+        if (*count < field->size()) {
+            propagate(decode_message(sub_decoder, (*field)[*count], 0));
+        } else {
+            decode_new_element(sub_decoder, *field, 0);
+        }
+        ++*count;
+    }
+
+    // Decode the message directly into a new element appended to the container
+    template <typename RepeatedMessageType>
+    auto decode_new_element(BasicDecoder sub_decoder, RepeatedMessageType& field, int)
+        -> decltype(field.emplace_back(), field.back(), void())
+    {
+        field.emplace_back();
+        propagate(decode_message(sub_decoder, field.back(), 0));
+    }
+
+    // Containers without emplace_back() get a copy of the decoded message
+    template <typename RepeatedMessageType>
+    void decode_new_element(BasicDecoder sub_decoder, RepeatedMessageType& field, long)
+    {
+        typename RepeatedMessageType::value_type value{};
+        propagate(decode_message(sub_decoder, value, 0));
+        field.push_back(std::move(value));
+    }
+
+    // get_repeated_string() and get_repeated_bytes() assigning over the element *count of the container
+    // like get_repeated_message(field, count), so std::string elements reuse their buffers
+    template <typename RepeatedStringType>
+    void get_repeated_string(RepeatedStringType *field, size_t *count)
+    {
+        string_view value = parse_string_value<typename RepeatedStringType::value_type>();
+        if (*count < field->size()) {
+            assign_string((*field)[*count], value, 0);
+        } else {
+            field->push_back(typename RepeatedStringType::value_type(value));
+        }
+        ++*count;
+    }
+
+    template <typename RepeatedStringType>
+    void get_repeated_bytes(RepeatedStringType *field, size_t *count)
+    {
+        get_repeated_string(field, count);
+    }
+
+    template <typename StringType>
+    static auto assign_string(StringType& str, string_view value, int) -> decltype(str.assign(value.data(), value.size()), void())
+    {
+        str.assign(value.data(), value.size());
+    }
+
+    template <typename StringType>
+    static void assign_string(StringType& str, string_view value, long)
+    {
+        str = StringType(value);
+    }
+
+    template <typename MessageType>
+    static void table_get_message(BasicDecoder& pb, void* field)
+    {
+        pb.get_message(static_cast<MessageType*>(field));
+    }
+
+    template <typename RepeatedMessageType>
+    static void table_get_repeated_message(BasicDecoder& pb, void* field)
+    {
+        pb.get_repeated_message(static_cast<RepeatedMessageType*>(field));
+    }
+
+    // Generated decoders return DecodeStatus, while custom ones may return void
+    template <typename MessageType>
+    static auto decode_message(BasicDecoder pb, MessageType& msg, int)
+        -> typename std::enable_if<std::is_convertible<decltype(decode(pb, msg)), DecodeStatus>::value, DecodeStatus>::type
+    {
+        return decode(pb, msg);
+    }
+
+    template <typename MessageType>
+    static DecodeStatus decode_message(BasicDecoder pb, MessageType& msg, long)
+    {
+        decode(pb, msg);
+        return DECODE_OK;
     }
 };
 
+using Decoder = BasicDecoder<CheckedInput>;
+using TrustedDecoder = BasicDecoder<TrustedInput>;
+
 
 // Matching decoding customization protocol:
-//   void decode(Decoder, T&);
+//   DecodeStatus decode(Decoder, T&);
 // Decoder is a cheap non-owning cursor and is deliberately passed by value.
+// The returned status is the final Decoder::status. Custom decoders may return void, if they never fail.
 template <typename MessageType>
 inline MessageType decode(string_view buffer)
 {
@@ -770,4 +2689,357 @@ inline MessageType decode(string_view buffer)
     return msg;
 }
 
+// Decode into the existing message, returning the decoding status. It's the way to check errors in the EASYPB_NO_EXCEPTIONS mode
+template <typename MessageType>
+inline DecodeStatus decode(string_view buffer, MessageType* msg)
+{
+    return Decoder::decode_message(Decoder(buffer), *msg, 0);
+}
+
+// Decode the message with strings and repeated fields allocated from the arena, see easypb::Arena
+template <typename MessageType>
+inline DecodeStatus decode(string_view buffer, MessageType* msg, Arena& arena)
+{
+    Decoder pb(buffer);
+    pb.arena = &arena;
+    return Decoder::decode_message(pb, *msg, 0);
+}
+
+// Decode the message pulled from the source in chunks, so that only the current top-level field is kept in memory
+template <typename MessageType>
+inline MessageType decode_from_source(Source source, size_t chunk_size = 64*1024)
+{
+    SourceBuffer input(std::move(source), chunk_size);
+    MessageType msg{};
+    decode(Decoder(input), msg);
+    return msg;
+}
+
+template <typename MessageType>
+inline DecodeStatus decode_from_source(Source source, MessageType* msg, size_t chunk_size = 64*1024)
+{
+    SourceBuffer input(std::move(source), chunk_size);
+    return Decoder::decode_message(Decoder(input), *msg, 0);
+}
+
+
+// Message field decoded on the first access (codegen --lazy). The Decoder only keeps the encoded message,
+// pointing into the input buffer, so the buffer should outlive the field. It's copied into the Decoder arena
+// if there is one, or else into the field itself in the streaming mode. The Encoder writes the kept bytes back as is,
+// unless the message was accessed for modification, so messages passed through untouched are neither
+// decoded nor encoded. A malformed message stays encoded and is reported on every access,
+// while in the EASYPB_NO_EXCEPTIONS mode, get() returns the default message and keeps the status in decode_status().
+// The first access modifies the object, so it isn't thread-safe even via const methods
+template <typename MessageType>
+class Lazy
+{
+public:
+    Lazy() = default;
+    Lazy(const MessageType& value) : message(value), state(MODIFIED)  {}
+    Lazy(MessageType&& value) : message(std::move(value)), state(MODIFIED)  {}
+
+    // The message, decoded on the first call
+    const MessageType& get() const
+    {
+        // The message is decoded into a temporary, so a malformed one stays encoded and is written back as is
+        if (state == ENCODED  &&  status == DECODE_OK) {
+            MessageType decoded{};
+            Decoder pb(encoded_message);
+            pb.arena = arena;
+            status = Decoder::decode_message(pb, decoded, 0);
+            if (status == DECODE_OK) {
+                message = std::move(decoded);
+                state = DECODED;
+            }
+        }
+        return message;
+    }
+
+    const MessageType& operator*() const   {return get();}
+    const MessageType* operator->() const  {return &get();}
+
+    // The message for modification, so it will be encoded anew
+    MessageType& mutable_get()
+    {
+        get();
+        state = MODIFIED;
+        return message;
+    }
+
+    // Is it the default message, that was neither decoded nor assigned?
+    bool empty() const  {return state == EMPTY;}
+
+    // Is the encoded message kept, so it's either not decoded yet or encoded as is?
+    bool has_encoded() const  {return state == ENCODED || state == DECODED;}
+    string_view encoded() const  {return encoded_message;}
+    bool is_decoded() const  {return state != ENCODED;}
+    DecodeStatus decode_status() const  {return status;}
+
+    // Keep the encoded message till the first access. Used by the Decoder
+    void set_encoded(string_view data, Arena* data_arena = nullptr)
+    {
+        if (state != EMPTY)  message = MessageType();
+        encoded_message = data;
+        owned_message.reset();
+        arena = data_arena;
+        state = ENCODED;
+        status = DECODE_OK;
+    }
+
+    // Keep a copy of the encoded message, shared by the copies of the field
+    void set_encoded_copy(string_view data)
+    {
+        auto copy = std::make_shared<const std::string>(data.data(), data.size());
+        set_encoded(string_view(copy->data(), copy->size()));
+        owned_message = std::move(copy);
+    }
+
+    // Reset to the empty message
+    void clear()
+    {
+        if (state != EMPTY)  message = MessageType();
+        encoded_message = string_view("", 0);
+        owned_message.reset();
+        state = EMPTY;
+        status = DECODE_OK;
+    }
+
+private:
+    enum State : uint8_t
+    {
+        EMPTY,     // default message
+        ENCODED,   // the encoded message isn't decoded yet
+        DECODED,   // the message is decoded, but not modified
+        MODIFIED,  // the message was assigned or accessed for modification, so the encoded one is stale
+    };
+
+    mutable MessageType message{};
+    string_view encoded_message{"", 0};
+    std::shared_ptr<const std::string> owned_message;  // storage of encoded_message, if it's copied
+    Arena* arena = nullptr;
+    mutable State state = EMPTY;
+    mutable DecodeStatus status = DECODE_OK;
+};
+
+// The encoded message is written as is, if it wasn't modified
+template <typename Writer, typename MessageType>
+inline void encode(Writer& pb, const Lazy<MessageType>& x)
+{
+    if (x.has_encoded()) {
+        pb.write_raw(x.encoded().data(), x.encoded().size());
+    } else {
+        encode(pb, x.get());
+    }
+}
+
+// The first occurrence of the message is kept encoded, while the next ones are merged into the decoded message
+template <typename InputPolicy, typename MessageType>
+inline DecodeStatus decode(BasicDecoder<InputPolicy> pb, Lazy<MessageType>& x)
+{
+    if (x.empty()) {
+        string_view data(pb.ptr, size_t(pb.buf_end - pb.ptr));
+        if (pb.arena) {
+            x.set_encoded(pb.arena->copy(data), pb.arena);
+        } else if (pb.streaming) {
+            x.set_encoded_copy(data);
+        } else {
+            x.set_encoded(data);
+        }
+        return pb.status;
+    }
+
+    x.get();
+    if (x.decode_status() != DECODE_OK)  return x.decode_status();
+    MessageType& message = x.mutable_get();
+    pb.merging = true;
+    return BasicDecoder<InputPolicy>::decode_message(pb, message, 0);
+}
+
+
+
+/*****************************************************************************
+Record streams: sequences of messages, each prefixed with its varint-encoded length.
+It's the format produced by Java writeDelimitedTo() and C++ SerializeDelimitedToOstream().
+*****************************************************************************/
+
+// Encoder of a record stream. The records go to the Encoder passed to the constructor,
+// so they may be collected in memory, streamed into a sink or stored in segments
+struct RecordWriter
+{
+    Encoder pb;
+    Sizer sizer;
+    bool keep_offsets;
+    std::vector<uint64_t> offsets;  // stream positions of the records written, if keep_offsets is set
+
+    explicit RecordWriter(Encoder encoder = Encoder(), bool keep_offsets = false)
+        : pb{std::move(encoder)}, keep_offsets{keep_offsets}
+    {
+    }
+
+    // Write the message with minimal-length prefixes, like encode_compact()
+    template <typename MessageType>
+    void write(const MessageType& msg)
+    {
+        sizer.size = 0;
+        sizer.lengths.clear();
+        encode(sizer, msg);
+        if (sizer.size > INT32_MAX) {
+            EASYPB_THROW(length_too_long("Record is too long with " + std::to_string(sizer.size) + " bytes"));
+        }
+
+        if (keep_offsets)  offsets.push_back(pb.pos());
+        pb.write_varint(sizer.size);
+        pb.lengths = sizer.lengths.data();
+        encode(pb, msg);
+        pb.lengths = nullptr;
+    }
+};
+
+// Decoder of a record stream. The records are returned without copying,
+// pointing into the data passed to the constructor or, in the streaming mode, into the SourceBuffer
+struct RecordReader
+{
+    Decoder pb;
+
+    explicit RecordReader(string_view data) noexcept
+        : pb{data}
+    {
+    }
+
+    explicit RecordReader(SourceBuffer& input) noexcept
+        : pb{input}
+    {
+    }
+
+    // Get the next encoded message, returning false at the end of the stream (or on error, see pb.status).
+    // In the streaming mode, the record is valid only till the next call.
+    bool next_record(string_view* record)
+    {
+        if (! pb.has_more())  return false;
+        *record = pb.read_bytearray();
+        return ! pb.failed();
+    }
+
+    // Decode the next message, returning false at the end of the stream (or on error, see pb.status)
+    template <typename MessageType>
+    bool next_message(MessageType* msg)
+    {
+        string_view record{"", 0};
+        if (! next_record(&record))  return false;
+        *msg = MessageType{};
+        pb.propagate(Decoder::decode_message(pb.nested(record), *msg, 0));
+        return ! pb.failed();
+    }
+};
+
+// Offsets of all records in the stream, e.g. to save them as a side index.
+// The decoding error, if any, is stored to *status in the EASYPB_NO_EXCEPTIONS mode
+inline std::vector<uint64_t> index_records(string_view data, DecodeStatus* status = nullptr)
+{
+    std::vector<uint64_t> offsets;
+    RecordReader reader(data);
+    string_view record{"", 0};
+    for (uint64_t offset = 0;  reader.next_record(&record);  offset = reader.pb.ptr - data.data()) {
+        offsets.push_back(offset);
+    }
+    if (status)  *status = reader.pb.status;
+    return offsets;
+}
+
+// The record starting at the offset, i.e. random access to the records by their index.
+// In the EASYPB_NO_EXCEPTIONS mode, an empty record is returned on error
+inline string_view record_at(string_view data, uint64_t offset, DecodeStatus* status = nullptr)
+{
+    if (offset >= data.size()) {
+#ifdef EASYPB_NO_EXCEPTIONS
+        if (status)  *status = DECODE_UNEXPECTED_EOF;
+        return {"", 0};
+#else
+        throw unexpected_eof("Record offset " + std::to_string(offset) + " is beyond the end of data");
+#endif
+    }
+    Decoder pb(data.data() + offset, size_t(data.size() - offset));
+    string_view record = pb.read_bytearray();
+    if (status)  *status = pb.status;
+    return record;
+}
+
+#ifdef EASYPB_PARALLEL
+// Decode all records of the stream using the given number of threads (0 means one per CPU core).
+// The stream is split at record boundaries into ranges of about the same size, one per thread,
+// and each thread decodes its records into its own part of the result, so the threads share no locks.
+// The first decoding error, if any, is stored to *status in the EASYPB_NO_EXCEPTIONS mode.
+// Define EASYPB_PARALLEL before including easypb.hpp to enable it, since it requires thread support
+template <typename MessageType>
+inline std::vector<MessageType> decode_records_parallel(string_view data, unsigned threads = 0, DecodeStatus* status = nullptr)
+{
+    DecodeStatus index_status = DECODE_OK;
+    const std::vector<uint64_t> offsets = index_records(data, &index_status);
+    std::vector<MessageType> messages(offsets.size());
+
+    if (threads == 0)  threads = std::thread::hardware_concurrency();
+    if (threads > offsets.size())  threads = unsigned(offsets.size());
+    if (threads == 0)  threads = 1;
+
+    // Records [first(i), first(i+1)) are decoded by the thread i
+    auto first = [&](unsigned i) -> size_t {
+        uint64_t start = data.size() / threads * i;
+        return std::lower_bound(offsets.begin(), offsets.end(), start) - offsets.begin();
+    };
+
+    std::vector<DecodeStatus> statuses(threads, DECODE_OK);
+#ifndef EASYPB_NO_EXCEPTIONS
+    std::vector<std::exception_ptr> errors(threads);
+#endif
+    auto decode_range = [&](unsigned i) {
+#ifndef EASYPB_NO_EXCEPTIONS
+        try {
+#endif
+            size_t last = (i+1 == threads? offsets.size() : first(i+1));
+            for (size_t n = first(i);  n < last  &&  statuses[i] == DECODE_OK;  n++) {
+                // The following records serve as the slop of this one
+                string_view record = record_at(data, offsets[n]);
+                size_t padding = data.data() + data.size() - (record.data() + record.size());
+                statuses[i] = Decoder::decode_message(Decoder(record, padding), messages[n], 0);
+            }
+#ifndef EASYPB_NO_EXCEPTIONS
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+#endif
+    };
+
+    std::vector<std::thread> workers;
+#ifndef EASYPB_NO_EXCEPTIONS
+    try {
+#endif
+        for (unsigned i = 1; i < threads; i++) {
+            workers.emplace_back(decode_range, i);
+        }
+#ifndef EASYPB_NO_EXCEPTIONS
+    } catch (...) {
+        for (auto& worker: workers)  worker.join();
+        throw;
+    }
+#endif
+    decode_range(0);
+    for (auto& worker: workers)  worker.join();
+
+#ifndef EASYPB_NO_EXCEPTIONS
+    for (auto& error: errors) {
+        if (error)  std::rethrow_exception(error);
+    }
+#endif
+    // The index_records() error is located after all the records decoded
+    statuses.push_back(index_status);
+    if (status) {
+        *status = DECODE_OK;
+        for (DecodeStatus x: statuses) {
+            if (*status == DECODE_OK)  *status = x;
+        }
+    }
+    return messages;
+}
+#endif  // EASYPB_PARALLEL
+
 }  // namespace easypb
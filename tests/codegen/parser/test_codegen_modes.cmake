@@ -79,24 +79,99 @@ if(FULL_BUILD)
         message(FATAL_ERROR "Proto3 source and descriptor-set outputs differ")
     endif()
 
-    string(FIND "${src3}" "put_packed_int32(1, x.implicit_packed)" implicit_pos)
+    string(FIND "${src3}" "put_packed_int32(easypb::FieldNum<1>(), x.implicit_packed)" implicit_pos)
     if(implicit_pos EQUAL -1)
         message(FATAL_ERROR "Implicit proto3 packed default was not applied")
     endif()
-    string(FIND "${src3}" "put_repeated_int32(2, x.explicit_unpacked)" explicit_pos)
+    string(FIND "${src3}" "put_repeated_int32(easypb::FieldNum<2>(), x.explicit_unpacked)" explicit_pos)
     if(explicit_pos EQUAL -1)
         message(FATAL_ERROR "Explicit packed=false was not applied")
     endif()
     run_ok(force_unpacked force_unpacked_err ${CODEGEN} --no-packed ${proto3})
-    string(FIND "${force_unpacked}" "put_repeated_int32(1, x.implicit_packed)" force_unpacked_pos)
+    string(FIND "${force_unpacked}" "put_repeated_int32(easypb::FieldNum<1>(), x.implicit_packed)" force_unpacked_pos)
     if(force_unpacked_pos EQUAL -1)
         message(FATAL_ERROR "--no-packed did not override proto3 default")
     endif()
     run_ok(force_packed force_packed_err ${CODEGEN} --packed ${proto3})
-    string(FIND "${force_packed}" "put_packed_int32(2, x.explicit_unpacked)" force_packed_pos)
+    string(FIND "${force_packed}" "put_packed_int32(easypb::FieldNum<2>(), x.explicit_unpacked)" force_packed_pos)
     if(force_packed_pos EQUAL -1)
         message(FATAL_ERROR "--packed did not override explicit packed=false")
     endif()
+    run_ok(table table_err ${CODEGEN} --table-decoder ${proto3})
+    string(FIND "${table}" "pb.get_next_field(fields, &x)" table_loop_pos)
+    string(FIND "${table}" "{easypb::field_tag(1, easypb::WIRETYPE_LENGTH_DELIMITED), easypb::FIELD_CUSTOM" table_packed_pos)
+    if(table_loop_pos EQUAL -1 OR table_packed_pos EQUAL -1)
+        message(FATAL_ERROR "--table-decoder did not generate the field table")
+    endif()
+    run_ok(reserve reserve_err ${CODEGEN} --reserve-fields ${DATA_DIR}/reserve-fields.proto)
+    string(FIND "${reserve}" "pb.reserve_fields(29);\n    pb.put_int32_unchecked(easypb::FieldNum<1>(), x.id);" reserve_first_pos)
+    string(FIND "${reserve}" "pb.commit_fields();\n    pb.put_string(easypb::FieldNum<4>(), x.name);\n    pb.put_bool(easypb::FieldNum<5>(), x.flag);" reserve_single_pos)
+    string(FIND "${reserve}" "pb.reserve_fields(19);" reserve_second_pos)
+    if(reserve_first_pos EQUAL -1 OR reserve_single_pos EQUAL -1 OR reserve_second_pos EQUAL -1)
+        message(FATAL_ERROR "--reserve-fields did not reserve space for runs of fixed-size fields:\n${reserve}")
+    endif()
+    run_ok(prescan prescan_err ${CODEGEN} --prescan-repeated ${proto2})
+    string(FIND "${prescan}" "easypb::field_tag(3, easypb::WIRETYPE_VARINT),\n        easypb::field_tag(4, easypb::WIRETYPE_FIXED32),\n        easypb::field_tag(5, easypb::WIRETYPE_LENGTH_DELIMITED),\n    };" prescan_tags_pos)
+    string(FIND "${prescan}" "pb.prescan_fields(repeated_tags, repeated_counts);" prescan_call_pos)
+    string(FIND "${prescan}" "easypb::reserve_space(x.plain_values, x.plain_values.size() + repeated_counts[1]);" prescan_reserve_pos)
+    string(FIND "${prescan}" "easypb::reserve_space(x.counts, x.counts.size() + repeated_counts[2]);" prescan_map_pos)
+    if(prescan_tags_pos EQUAL -1 OR prescan_call_pos EQUAL -1 OR prescan_reserve_pos EQUAL -1 OR prescan_map_pos EQUAL -1)
+        message(FATAL_ERROR "--prescan-repeated did not reserve space for unpacked repeated fields:\n${prescan}")
+    endif()
+    set(reuse_proto "${DATA_DIR}/reuse-storage.proto")
+    run_ok(reuse reuse_err ${CODEGEN} --reuse-storage ${reuse_proto})
+    string(FIND "${reuse}" "    if(! pb.merging)\n    {\n        x.id = 7;\n        x.has_id = false;\n        easypb::clear_value(x.name);" reuse_reset_pos)
+    string(FIND "${reuse}" "size_t items_count = (pb.merging? x.items.size() : 0);\n    size_t names_count = (pb.merging? x.names.size() : 0);\n    if(! pb.merging)\n    {\n        easypb::clear_value(x.deltas);\n        x.has_first = false;\n    }" reuse_counts_pos)
+    string(FIND "${reuse}" "pb.get_repeated_message(&x.items, &items_count);" reuse_decode_pos)
+    string(FIND "${reuse}" "easypb::truncate(x.names, names_count);\n    if(! x.has_first)  easypb::clear_value(x.first);" reuse_cleanup_pos)
+    if(reuse_reset_pos EQUAL -1 OR reuse_counts_pos EQUAL -1 OR reuse_decode_pos EQUAL -1 OR reuse_cleanup_pos EQUAL -1)
+        message(FATAL_ERROR "--reuse-storage did not decode over the existing fields:\n${reuse}")
+    endif()
+    run_ok(reuse_table reuse_table_err ${CODEGEN} --reuse-storage --table-decoder --no-has-fields ${reuse_proto})
+    string(FIND "${reuse_table}" "            case 2: pb.get_repeated_string(&x.names, &names_count); break;\n" reuse_table_case_pos)
+    string(FIND "${reuse_table}" "table_get_repeated_string" reuse_table_entry_pos)
+    string(FIND "${reuse_table}" "            case 4: pb.get_message(&x.first, &first_found); break;\n#ifdef" reuse_found_pos)
+    string(FIND "${reuse_table}" "offsetof(Items, first)" reuse_table_message_pos)
+    if(reuse_table_case_pos EQUAL -1 OR NOT reuse_table_entry_pos EQUAL -1 OR reuse_found_pos EQUAL -1
+       OR NOT reuse_table_message_pos EQUAL -1)
+        message(FATAL_ERROR "--reuse-storage --table-decoder did not move reused fields out of the table:\n${reuse_table}")
+    endif()
+    run_ok(arena arena_err ${CODEGEN} --arena --reuse-storage ${reuse_proto})
+    string(FIND "${arena}" "    easypb::string_view name;\n" arena_string_pos)
+    string(FIND "${arena}" "    easypb::ArenaVector<Item> items;\n    easypb::ArenaVector<easypb::string_view> names;\n" arena_vector_pos)
+    string(FIND "${arena}" "        easypb::clear_value(x.deltas);\n        x.has_first = false;\n    }\n    easypb::attach_arena(x.items, pb.arena);\n" arena_attach_pos)
+    if(arena_string_pos EQUAL -1 OR arena_vector_pos EQUAL -1 OR arena_attach_pos EQUAL -1)
+        message(FATAL_ERROR "--arena did not allocate repeated fields and strings from the arena:\n${arena}")
+    endif()
+    run_ok(arena_types arena_types_err ${CODEGEN} --arena -s std::string -r std::deque ${reuse_proto})
+    string(FIND "${arena_types}" "    std::deque<std::string> names;\n" arena_types_pos)
+    if(arena_types_pos EQUAL -1)
+        message(FATAL_ERROR "--arena overrode the explicit C++ types:\n${arena_types}")
+    endif()
+    run_ok(lazy lazy_err ${CODEGEN} --lazy-field Items.first --reuse-storage ${reuse_proto})
+    string(FIND "${lazy}" "    std::vector<Item> items;\n" lazy_eager_pos)
+    string(FIND "${lazy}" "    easypb::Lazy<Item> first;\n" lazy_field_pos)
+    string(FIND "${lazy}" "        easypb::clear_value(x.first);\n        x.has_first = false;\n" lazy_reset_pos)
+    string(FIND "${lazy}" "if(! x.has_first)" lazy_cleanup_pos)
+    if(lazy_eager_pos EQUAL -1 OR lazy_field_pos EQUAL -1 OR lazy_reset_pos EQUAL -1 OR NOT lazy_cleanup_pos EQUAL -1)
+        message(FATAL_ERROR "--lazy-field did not make the only field lazy:\n${lazy}")
+    endif()
+    run_ok(lazy_all lazy_all_err ${CODEGEN} --lazy --reuse-storage ${reuse_proto})
+    string(FIND "${lazy_all}" "    std::vector<easypb::Lazy<Item>> items;\n" lazy_repeated_pos)
+    string(FIND "${lazy_all}" "            case 1: pb.get_repeated_message(&x.items); break;\n" lazy_decode_pos)
+    if(lazy_repeated_pos EQUAL -1 OR lazy_decode_pos EQUAL -1)
+        message(FATAL_ERROR "--lazy did not make repeated messages lazy:\n${lazy_all}")
+    endif()
+
+    string(FIND "${src3}" "inline void encode(easypb::Sizer &pb" sizer_pos)
+    if(sizer_pos EQUAL -1)
+        message(FATAL_ERROR "Sizer overloads were not generated")
+    endif()
+    run_ok(no_sizer no_sizer_err ${CODEGEN} --no-sizer ${proto3})
+    string(FIND "${no_sizer}" "easypb::Sizer" no_sizer_pos)
+    if(NOT no_sizer_pos EQUAL -1)
+        message(FATAL_ERROR "--no-sizer did not suppress Sizer overloads")
+    endif()
 
     run_ok(print_out print_err ${CODEGEN} --print-descriptor ${proto2})
     if(NOT print_out MATCHES "message Proto2Message")
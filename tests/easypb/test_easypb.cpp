@@ -0,0 +1,1408 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <easypb.hpp>
+
+namespace test {
+
+struct Point
+{
+    int32_t x = 0;
+    int32_t y = 0;
+};
+
+struct Shape
+{
+    std::string name;
+    std::vector<Point> points;
+    std::vector<int64_t> ids;
+    std::map<uint32_t, std::string> labels;
+};
+
+// The same code serves both Encoder and Sizer
+template <typename Writer>
+void encode(Writer& pb, const Point& x)
+{
+    pb.put_sint32(1, x.x);
+    pb.put_sint32(2, x.y);
+}
+
+template <typename Writer>
+void encode(Writer& pb, const Shape& x)
+{
+    pb.put_string(1, x.name);
+    pb.put_repeated_message(2, x.points);
+    pb.put_packed_int64(3, x.ids);
+    pb.put_map_uint32_string(4, x.labels);
+}
+
+void decode(easypb::Decoder pb, Point& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_sint32(&x.x); break;
+            case 2: pb.get_sint32(&x.y); break;
+            default: pb.skip_field();
+        }
+    }
+}
+
+void decode(easypb::Decoder pb, Shape& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_string(&x.name); break;
+            case 2: pb.get_repeated_message(&x.points); break;
+            case 3: pb.get_repeated_int64(&x.ids); break;
+            case 4: pb.get_map_uint32_string(&x.labels); break;
+            default: pb.skip_field();
+        }
+    }
+}
+
+enum class Level : int32_t {LOW = 1, HIGH = -2};
+
+// A message decoded by the field table, in the form produced by Codegen --table-decoder
+struct Sample
+{
+    int32_t id = 0;
+    double weight = 0;
+    bool flag = false;
+    int64_t delta = 0;
+    std::string text;
+    Point origin;
+    std::vector<uint64_t> values;
+    std::map<uint32_t, std::string> labels;
+    Level level = Level::LOW;  // enum stored as FIELD_VARINT32
+    uint32_t extra = 0;  // decoded by the switch, like EASYPB_Sample_EXTRA_DECODING
+
+    bool has_id = false;
+    bool has_origin = false;
+};
+
+EASYPB_TABLE_DECODER_BEGIN
+template <typename InputPolicy>
+easypb::DecodeStatus decode(easypb::BasicDecoder<InputPolicy> pb, Sample& x)
+{
+    using Decoder = easypb::BasicDecoder<InputPolicy>;
+    static constexpr easypb::FieldEntry<Decoder> fields[] = {
+        {easypb::field_tag(1, easypb::WIRETYPE_VARINT), easypb::FIELD_VARINT32, offsetof(Sample, id), offsetof(Sample, has_id), nullptr},
+        {easypb::field_tag(2, easypb::WIRETYPE_FIXED64), easypb::FIELD_DOUBLE, offsetof(Sample, weight), easypb::NO_HAS_FIELD, nullptr},
+        {easypb::field_tag(3, easypb::WIRETYPE_VARINT), easypb::FIELD_BOOL, offsetof(Sample, flag), easypb::NO_HAS_FIELD, nullptr},
+        {easypb::field_tag(4, easypb::WIRETYPE_VARINT), easypb::FIELD_SINT64, offsetof(Sample, delta), easypb::NO_HAS_FIELD, nullptr},
+        {easypb::field_tag(5, easypb::WIRETYPE_LENGTH_DELIMITED), easypb::FIELD_STRING, offsetof(Sample, text), easypb::NO_HAS_FIELD, nullptr},
+        {easypb::field_tag(6, easypb::WIRETYPE_LENGTH_DELIMITED), easypb::FIELD_CUSTOM, offsetof(Sample, origin), offsetof(Sample, has_origin),
+            &Decoder::template table_get_message<Point>},
+        {easypb::field_tag(7, easypb::WIRETYPE_LENGTH_DELIMITED), easypb::FIELD_CUSTOM, offsetof(Sample, values), easypb::NO_HAS_FIELD,
+            &Decoder::template table_get_repeated_uint64<std::vector<uint64_t>>},
+        {easypb::field_tag(8, easypb::WIRETYPE_LENGTH_DELIMITED), easypb::FIELD_CUSTOM, offsetof(Sample, labels), easypb::NO_HAS_FIELD,
+            &Decoder::template table_get_map_uint32_string<std::map<uint32_t, std::string>>},
+        {easypb::field_tag(9, easypb::WIRETYPE_VARINT), easypb::FIELD_VARINT32, offsetof(Sample, level), easypb::NO_HAS_FIELD, nullptr},
+    };
+
+    while (pb.get_next_field(fields, &x)) {
+        switch (pb.field_num) {
+            case 100: pb.get_uint32(&x.extra); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+EASYPB_TABLE_DECODER_END
+
+// A message encoded in the form produced by Codegen --reserve-fields
+struct Reading
+{
+    int32_t id = 0;
+    double value = 0;
+    int64_t delta = 0;
+    std::string unit;
+    uint32_t flags = 0;
+    bool valid = false;
+};
+
+template <typename Writer>
+void encode(Writer& pb, const Reading& x)
+{
+    pb.reserve_fields(31);
+    pb.put_int32_unchecked(easypb::FieldNum<1>(), x.id);
+    pb.put_double_unchecked(easypb::FieldNum<2>(), x.value);
+    pb.put_sint64_unchecked(easypb::FieldNum<3>(), x.delta);
+    pb.commit_fields();
+    pb.put_string(easypb::FieldNum<4>(), x.unit);
+    pb.reserve_fields(8);
+    pb.put_uint32_unchecked(easypb::FieldNum<5>(), x.flags);
+    pb.put_bool_unchecked(easypb::FieldNum<6>(), x.valid);
+    pb.commit_fields();
+}
+
+// Messages decoded over the existing ones, in the form produced by Codegen --reuse-storage
+struct Outline
+{
+    std::string name;
+    std::vector<Point> points;
+
+    bool has_name = false;
+};
+
+struct Frame
+{
+    uint32_t id = 0;
+    Outline outline;
+
+    bool has_id = false;
+    bool has_outline = false;
+};
+
+template <typename Writer>
+void encode(Writer& pb, const Outline& x)
+{
+    if (x.has_name)  pb.put_string(1, x.name);
+    pb.put_repeated_message(2, x.points);
+}
+
+template <typename Writer>
+void encode(Writer& pb, const Frame& x)
+{
+    if (x.has_id)  pb.put_uint32(1, x.id);
+    if (x.has_outline)  pb.put_message(2, x.outline);
+}
+
+void decode(easypb::Decoder pb, Outline& x)
+{
+    size_t points_count = (pb.merging? x.points.size() : 0);
+    if (! pb.merging) {
+        easypb::clear_value(x.name);
+        x.has_name = false;
+    }
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_string(&x.name, &x.has_name); break;
+            case 2: pb.get_repeated_message(&x.points, &points_count); break;
+            default: pb.skip_field();
+        }
+    }
+    easypb::truncate(x.points, points_count);
+}
+
+void decode(easypb::Decoder pb, Frame& x)
+{
+    if (! pb.merging) {
+        x.id = 0;
+        x.has_id = false;
+        x.has_outline = false;
+    }
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_uint32(&x.id, &x.has_id); break;
+            case 2: pb.get_message(&x.outline, &x.has_outline); break;
+            default: pb.skip_field();
+        }
+    }
+    if (! x.has_outline)  easypb::clear_value(x.outline);
+}
+
+bool operator==(const Point& a, const Point& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+bool operator==(const Shape& a, const Shape& b)
+{
+    return a.name == b.name && a.points == b.points && a.ids == b.ids && a.labels == b.labels;
+}
+
+} // namespace test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* expression, const char* file, int line)
+{
+    if (!condition) {
+        std::cerr << file << ':' << line << ": CHECK failed: " << expression << '\n';
+        ++failures;
+    }
+}
+
+#define CHECK(x) check((x), #x, __FILE__, __LINE__)
+
+test::Shape make_shape()
+{
+    test::Shape shape;
+    shape.name = "triangle";
+    for (int32_t i = 0; i < 3; ++i) {
+        test::Point point;
+        point.x = -i;
+        point.y = i * 1000;
+        shape.points.push_back(point);
+    }
+    shape.ids.push_back(1);
+    shape.ids.push_back(-1);
+    shape.ids.push_back(INT64_MAX);
+    shape.labels[7] = "seven";
+    shape.labels[300] = std::string(200, 'x');
+    return shape;
+}
+
+void test_varint_size()
+{
+    CHECK(easypb::varint_size(0) == 1);
+    CHECK(easypb::varint_size(127) == 1);
+    CHECK(easypb::varint_size(128) == 2);
+    CHECK(easypb::varint_size(UINT32_MAX) == 5);
+    CHECK(easypb::varint_size(UINT64_MAX) == 10);
+    for (int bits = 1; bits <= 64; ++bits) {
+        CHECK(easypb::varint_size(UINT64_MAX >> (64 - bits)) == size_t(bits + 6) / 7);
+    }
+}
+
+void test_read_varint()
+{
+    // Values of every bit length, decoded both by the fast path and by read_varint_slow() near the buffer end
+    for (int bits = 0; bits <= 64; ++bits) {
+        const uint64_t value = (bits == 0? 0 : UINT64_MAX >> (64 - bits));
+        const uint64_t values[2] = {value, value ^ (value >> 1)};
+        for (uint64_t x: values) {
+            easypb::Encoder pb;
+            pb.write_varint(x);
+            const size_t size = pb.pos();
+            pb.write_varint(x);
+            const std::string data = pb.result();
+
+            easypb::Decoder decoder(data);
+            CHECK(decoder.read_varint() == x);
+            CHECK(decoder.ptr == data.data() + size);
+            CHECK(decoder.read_varint() == x);
+            CHECK(decoder.eof());
+        }
+    }
+
+    const std::string too_long(11, '\xff');
+    bool thrown = false;
+    try {
+        easypb::Decoder(too_long).read_varint();
+    } catch (const easypb::varint_too_long&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+void test_packed_varints()
+{
+    // Runs of 1-byte varints of different lengths, separated by long ones
+    std::vector<int64_t> values;
+    for (int run = 0; run < 20; ++run) {
+        for (int i = 0; i < run; ++i) {
+            values.push_back(i * 5);
+        }
+        values.push_back(run % 2? -run : int64_t(1) << (run * 3));
+    }
+    values.push_back(1);
+
+    test::Shape shape;
+    shape.ids = values;
+    const std::string encoded = easypb::encode(shape);
+    const test::Shape decoded = easypb::decode<test::Shape>(encoded);
+    CHECK(decoded.ids == values);
+    CHECK(decoded.ids.capacity() == values.size());
+
+    // Exact length prefix, also when the field spans several segments
+    easypb::Encoder pb = easypb::Encoder::segmented(16);
+    pb.put_packed_int64(3, values);
+    const std::string field = pb.result();
+    CHECK(field == encoded.substr(encoded.size() - field.size()));
+    CHECK(field.size() == 1 + easypb::varint_size(field.size() - 3) + field.size() - 3);
+
+    pb.put_packed_int32(1, std::vector<int32_t>({1, 300, -1}));
+    CHECK(pb.result() == std::string("\x0a\x0d\x01\xac\x02\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 15));
+
+    // The longest varints fill the whole slot reserved for the length, and shorter ones are moved back
+    pb = easypb::Encoder();
+    pb.put_packed_int32(1, std::vector<int32_t>(20, -1));
+    const std::string negatives = pb.result();
+    CHECK(negatives.size() == 203 && negatives.substr(0, 5) == "\x0a\xc8\x01\xff\xff");
+    CHECK(negatives.substr(193) == std::string(9, '\xff') + "\x01");
+    pb.put_packed_int32(1, std::vector<int32_t>(20, 1));
+    CHECK(pb.result() == "\x0a\x14" + std::string(20, '\x01'));
+
+    const std::string packed("\x01\x02\x03\x04\x05\x06\x07\x08\x09\xac\x02\x0b", 12);
+    easypb::Decoder packed_decoder(packed);
+    CHECK(packed_decoder.count_varints() == 11);
+    std::vector<uint32_t> uint32_values;
+    packed_decoder.read_packed_varints<uint32_t, uint32_t>(&uint32_values);
+    CHECK(uint32_values.size() == 11 && uint32_values[8] == 9 && uint32_values[9] == 300 && uint32_values[10] == 11);
+
+    // A packed field ending in the middle of varint
+    pb = easypb::Encoder();
+    pb.write_field_tag(3, easypb::WIRETYPE_LENGTH_DELIMITED);
+    pb.write_bytearray(std::string("\x01\x02\x80", 3));
+    bool eof = false;
+    try {
+        easypb::decode<test::Shape>(pb.result());
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+
+void test_packed_zigzag()
+{
+    std::vector<int64_t> sint64_values = {0, -1, 1, -64, 64, INT64_MIN, INT64_MAX};
+    for (int i = -100; i < 100; i += 3) {
+        sint64_values.push_back(i);
+    }
+    const std::list<int32_t> sint32_values = {INT32_MIN, -5, 0, 5, INT32_MAX};
+    const std::vector<bool> bool_values = {true, false, true};
+
+    auto put_fields = [&](easypb::Encoder& pb) {
+        pb.put_packed_sint64(1, sint64_values);
+        pb.put_packed_sint32(2, sint32_values);
+        pb.put_packed_bool(3, bool_values);
+    };
+    easypb::Encoder pb;
+    put_fields(pb);
+    const std::string data = pb.result();
+
+    // Zigzag maps small magnitudes to short varints. They are written by the branchless stores in a single pass
+    // after a 2-byte slot for the length, and then moved back, since the length is only 1 byte
+    CHECK(data.substr(0, 8) == std::string("\x0a\x75" "\x00\x01\x02\x7f\x80\x01", 8));
+    CHECK(data.substr(119, 15) == std::string("\x12\x0d" "\xff\xff\xff\xff\x0f" "\x09\x00\x0a" "\xfe\xff\xff\xff\x0f", 15));
+
+    // Compact encoding into the exact-size buffer, whose end is reached in the middle of the packed field
+    easypb::Sizer sizer;
+    sizer.put_packed_sint64(1, sint64_values);
+    sizer.put_packed_sint32(2, sint32_values);
+    sizer.put_packed_bool(3, bool_values);
+    CHECK(sizer.size == data.size() && sizer.lengths.empty());
+
+    std::string compact(sizer.size, '\0');
+    easypb::Encoder compact_pb(&compact[0], compact.size());
+    compact_pb.lengths = sizer.lengths.data();
+    put_fields(compact_pb);
+    CHECK(compact_pb.pos() == compact.size() && compact == data);
+
+    // Varints crossing segment boundaries
+    easypb::Encoder segmented_pb = easypb::Encoder::segmented(16);
+    put_fields(segmented_pb);
+    CHECK(segmented_pb.result() == data);
+
+    std::vector<int64_t> decoded_sint64;
+    std::list<int32_t> decoded_sint32;
+    std::vector<bool> decoded_bools;
+    easypb::Decoder decoder(data);
+    while (decoder.get_next_field()) {
+        switch (decoder.field_num) {
+            case 1: decoder.get_repeated_sint64(&decoded_sint64); break;
+            case 2: decoder.get_repeated_sint32(&decoded_sint32); break;
+            case 3: decoder.get_repeated_bool(&decoded_bools); break;
+            default: decoder.skip_field();
+        }
+    }
+    CHECK(decoded_sint64 == sint64_values);
+    CHECK(decoded_sint32 == sint32_values);
+    CHECK(decoded_bools == bool_values);
+
+    decoded_sint64.clear();
+    easypb::Decoder compact_decoder(compact);
+    while (compact_decoder.get_next_field()) {
+        if (compact_decoder.field_num == 1)  compact_decoder.get_repeated_sint64(&decoded_sint64);
+        else compact_decoder.skip_field();
+    }
+    CHECK(decoded_sint64 == sint64_values);
+}
+
+void test_packed_fixed()
+{
+    const std::vector<double> doubles = {1.5, -2.25, 1e300};
+    const std::list<uint32_t> fixeds = {1, 0xdeadbeef};
+
+    easypb::Encoder pb;
+    pb.put_packed_double(1, doubles);
+    pb.put_packed_fixed32(2, fixeds);
+    const std::string data = pb.result();
+
+    // The exact lengths are written without reserving 5-byte prefixes
+    CHECK(data.size() == 2 + 3*8 + 2 + 2*4);
+    easypb::Sizer sizer;
+    sizer.put_packed_double(1, doubles);
+    sizer.put_packed_fixed32(2, fixeds);
+    CHECK(sizer.size == data.size() && sizer.lengths.empty());
+
+    std::vector<double> decoded_doubles = {0.5};
+    std::vector<float> decoded_floats;
+    std::list<uint32_t> decoded_fixeds;
+    easypb::Decoder decoder(data);
+    while (decoder.get_next_field()) {
+        if (decoder.field_num == 1) {
+            easypb::Decoder copy = decoder;
+            decoder.get_repeated_double(&decoded_doubles);
+            copy.get_repeated_double(&decoded_floats);
+        } else {
+            decoder.get_repeated_fixed32(&decoded_fixeds);
+        }
+    }
+    CHECK(decoded_doubles == std::vector<double>({0.5, 1.5, -2.25, 1e300}));
+    CHECK(decoded_floats == std::vector<float>({1.5f, -2.25f, float(1e300)}));
+    CHECK(decoded_fixeds == fixeds);
+
+    // The payload isn't a multiple of the value size
+    const std::string truncated_data("\x0a\x07" "1234567", 9);
+    easypb::Decoder truncated(truncated_data);
+    truncated.get_next_field();
+    bool eof = false;
+    try {
+        truncated.get_repeated_double(&decoded_doubles);
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+
+void test_compact_encoding()
+{
+    const test::Shape shape = make_shape();
+    const std::string padded = easypb::encode(shape);
+    const std::string compact = easypb::encode_compact(shape);
+
+    CHECK(easypb::encoded_size(shape) == compact.size());
+    CHECK(compact.size() < padded.size());
+    CHECK(easypb::decode<test::Shape>(padded) == shape);
+    CHECK(easypb::decode<test::Shape>(compact) == shape);
+
+    // Nested Point {0, 0} and empty packed ids get 1-byte length prefixes
+    test::Shape single;
+    single.points.resize(1);
+    const std::string single_compact = easypb::encode_compact(single);
+    CHECK(single_compact == std::string("\x0a\x00" "\x12\x04\x08\x00\x10\x00" "\x1a\x00", 10));
+}
+
+void test_external_memory()
+{
+    const test::Shape shape = make_shape();
+    const std::string expected = easypb::encode(shape);
+
+    std::vector<char> memory(expected.size() + 16, '#');
+    const size_t written = easypb::encode(shape, memory.data(), memory.size());
+    CHECK(written == expected.size());
+    CHECK(std::string(memory.data(), written) == expected);
+    CHECK(memory[written] == '#');
+
+    // The buffer of exactly the right size is filled up to the last byte
+    std::vector<char> exact(expected.size());
+    CHECK(easypb::encode(shape, exact.data(), exact.size()) == expected.size());
+
+    std::vector<char> small(expected.size() - 1);
+    bool overflow = false;
+    try {
+        easypb::encode(shape, small.data(), small.size());
+    } catch (const easypb::buffer_overflow&) {
+        overflow = true;
+    }
+    CHECK(overflow);
+}
+
+// Field tags precomputed from FieldNum<N> are the same as ones encoded at runtime
+template <uint32_t N>
+void check_constant_field_tag()
+{
+    easypb::Encoder runtime_pb;
+    runtime_pb.put_sint32(N, -1);
+    runtime_pb.put_fixed64(N, 2);
+    runtime_pb.put_string(N, std::string("abc"));
+    const std::string expected = runtime_pb.result();
+
+    std::vector<char> exact(expected.size());
+    easypb::Encoder pb(exact.data(), exact.size());
+    pb.put_sint32(easypb::FieldNum<N>(), -1);
+    pb.put_fixed64(easypb::FieldNum<N>(), 2);
+    pb.put_string(easypb::FieldNum<N>(), std::string("abc"));
+    CHECK(std::string(pb.view()) == expected);
+
+    easypb::Sizer sizer;
+    sizer.put_sint32(easypb::FieldNum<N>(), -1);
+    sizer.put_fixed64(easypb::FieldNum<N>(), 2);
+    sizer.put_string(easypb::FieldNum<N>(), std::string("abc"));
+    CHECK(sizer.size == expected.size());
+}
+
+void test_constant_field_tags()
+{
+    // Tags of 1 to 5 bytes, including the largest field number
+    check_constant_field_tag<1>();
+    check_constant_field_tag<15>();
+    check_constant_field_tag<16>();
+    check_constant_field_tag<2047>();
+    check_constant_field_tag<2048>();
+    check_constant_field_tag<262144>();
+    check_constant_field_tag<536870911>();
+
+    std::map<int32_t, std::string> map;
+    map[-1] = "x";
+    easypb::Encoder runtime_pb, constant_pb;
+    runtime_pb.put_map_int32_string(5, map);
+    constant_pb.put_map_int32_string(easypb::FieldNum<5>(), map);
+    CHECK(runtime_pb.result() == constant_pb.result());
+}
+
+void test_reserved_fields()
+{
+    test::Reading reading;
+    reading.id = -1;
+    reading.value = 2.5;
+    reading.delta = -300;
+    reading.unit = "kPa";
+    reading.flags = 70000;
+    reading.valid = true;
+
+    easypb::Encoder plain_pb;
+    plain_pb.put_int32(1, reading.id);
+    plain_pb.put_double(2, reading.value);
+    plain_pb.put_sint64(3, reading.delta);
+    plain_pb.put_string(4, reading.unit);
+    plain_pb.put_uint32(5, reading.flags);
+    plain_pb.put_bool(6, reading.valid);
+    const std::string expected = plain_pb.result();
+
+    CHECK(easypb::encode(reading) == expected);
+    CHECK(easypb::encoded_size(reading) == expected.size());
+
+    // The second reservation exceeds the rest of external memory, so these fields go through the scratch space
+    std::vector<char> exact(expected.size());
+    CHECK(easypb::encode(reading, exact.data(), exact.size()) == expected.size());
+    CHECK(std::string(exact.data(), exact.size()) == expected);
+
+    std::vector<char> small(expected.size() - 1);
+    bool overflow = false;
+    try {
+        easypb::encode(reading, small.data(), small.size());
+    } catch (const easypb::buffer_overflow&) {
+        overflow = true;
+    }
+    CHECK(overflow);
+
+    // The Encoder moved in the middle of reservation keeps writing into the scratch space
+    std::vector<char> tight(4);
+    easypb::Encoder tight_pb(tight.data(), tight.size());
+    tight_pb.reserve_fields(8);
+    tight_pb.put_uint32_unchecked(easypb::FieldNum<5>(), 1);
+    easypb::Encoder moved_pb;
+    moved_pb = std::move(tight_pb);
+    moved_pb.put_bool_unchecked(easypb::FieldNum<6>(), true);
+    moved_pb.commit_fields();
+    CHECK(moved_pb.pos() == 4 && std::string(tight.data(), 4) == std::string("\x28\x01\x30\x01", 4));
+    CHECK(! tight_pb.saved_ptr && tight_pb.scratch.empty());
+
+    // reset() drops the reservation interrupted in the scratch space, so the next message goes to external memory
+    easypb::Encoder reset_pb(exact.data(), exact.size());
+    reset_pb.put_int32(1, reading.id);
+    reset_pb.reserve_fields(exact.size());
+    reset_pb.put_uint32_unchecked(easypb::FieldNum<5>(), 1);
+    reset_pb.reset();
+    CHECK(! reset_pb.saved_ptr && reset_pb.pos() == 0);
+    std::fill(exact.begin(), exact.end(), '\0');
+    encode(reset_pb, reading);
+    CHECK(reset_pb.pos() == expected.size() && std::string(exact.data(), exact.size()) == expected);
+
+    // Reservations larger than the segment or sink buffer
+    easypb::Encoder segmented_pb = easypb::Encoder::segmented(8);
+    encode(segmented_pb, reading);
+    encode(segmented_pb, reading);
+    CHECK(segmented_pb.result() == expected + expected);
+
+    std::string stream;
+    easypb::Encoder sink_pb([&](const char* data, size_t size) {stream.append(data, size);}, 8);
+    encode(sink_pb, reading);
+    encode(sink_pb, reading);
+    sink_pb.flush();
+    CHECK(stream == expected + expected);
+}
+
+void test_encoder_reuse()
+{
+    const test::Shape shape = make_shape();
+    const std::string expected = easypb::encode(shape);
+
+    easypb::Encoder pb;
+    encode(pb, shape);
+    const char* const data = pb.view().data();
+    CHECK(std::string(pb.view()) == expected);
+
+    // reset() keeps the allocated space, so the second message is encoded in place
+    pb.reset();
+    CHECK(pb.pos() == 0);
+    encode(pb, shape);
+    CHECK(pb.view().data() == data);
+    CHECK(std::string(pb.view()) == expected);
+}
+
+void test_streaming()
+{
+    const test::Shape shape = make_shape();
+    std::string stream;
+    size_t chunks = 0, max_chunk = 0;
+    easypb::Sink sink = [&](const char* data, size_t size) {
+        stream.append(data, size);
+        chunks++;
+        max_chunk = std::max(max_chunk, size);
+    };
+
+    // Precomputed lengths allow flushing every full buffer
+    easypb::encode_to_sink(shape, sink, 16);
+    CHECK(stream == easypb::encode_compact(shape));
+    CHECK(chunks > 1);
+
+    // With back-patched lengths, a nested message stays in the buffer till it's committed.
+    // The 200-byte label makes the buffer grow beyond the initial 16 bytes.
+    stream.clear();
+    chunks = max_chunk = 0;
+    easypb::Encoder pb(sink, 16);
+    encode(pb, shape);
+    encode(pb, shape);
+    pb.flush();
+    CHECK(stream == easypb::encode(shape) + easypb::encode(shape));
+    CHECK(chunks > 2);
+    CHECK(max_chunk > 200);
+
+    std::ostringstream output;
+    easypb::encode_to_sink(shape, easypb::stream_sink(output));
+    CHECK(output.str() == easypb::encode_compact(shape));
+
+    // A packed field much larger than the buffer is passed to the sink in parts, without growing the buffer
+    std::vector<int64_t> values;
+    for (int64_t i = 0; i < 100000; ++i) {
+        values.push_back(i % 3? i : -i);
+    }
+    easypb::Encoder owned;
+    owned.put_packed_int64(1, values);
+    stream.clear();
+    chunks = 0;
+    easypb::Encoder packed_pb(sink, 4096);
+    packed_pb.put_packed_int64(1, values);
+    packed_pb.flush();
+    CHECK(stream == owned.result());
+    CHECK(chunks > 100);
+    CHECK(packed_pb.buf_end - packed_pb.buf_begin == 4096);
+
+    // The same for a large bytes field and a packed fixed-width one
+    const std::string blob(100000, 'x');
+    const std::vector<double> doubles(10000, 1.5);
+    owned.put_bytes(2, blob);
+    owned.put_packed_double(3, doubles);
+    stream.clear();
+    packed_pb.put_bytes(2, blob);
+    packed_pb.put_packed_double(3, doubles);
+    packed_pb.flush();
+    CHECK(stream == owned.result());
+    CHECK(packed_pb.buf_end - packed_pb.buf_begin == 4096);
+}
+
+void test_segmented()
+{
+    const test::Shape shape = make_shape();
+    const std::string expected = easypb::encode(shape);
+
+    // Small blocks make nested messages span several of them, so their lengths are back-patched in earlier blocks
+    easypb::Encoder pb = easypb::Encoder::segmented(16);
+    encode(pb, shape);
+    std::vector<easypb::string_view> pieces = pb.segments();
+    CHECK(pieces.size() > 2);
+    const char* const first = pieces[0].data();
+
+    std::string joined;
+    for (auto piece: pieces) {
+        joined.append(piece.data(), piece.size());
+    }
+    CHECK(joined == expected);
+
+    // Written data never move
+    encode(pb, shape);
+    CHECK(pb.segments()[0].data() == first);
+
+    // reset() reuses the blocks
+    pb.reset();
+    encode(pb, shape);
+    CHECK(pb.segments()[0].data() == first);
+    CHECK(pb.segments().size() == pieces.size());
+    CHECK(pb.result() == expected);
+    CHECK(pb.segments().empty());
+}
+
+void test_streaming_decoder()
+{
+    const test::Shape shape = make_shape();
+    const std::string encoded = easypb::encode(shape);
+
+    // The source returning a single byte per call splits every field and varint between chunks
+    size_t pos = 0;
+    easypb::Source trickle = [&](char* data, size_t size) -> size_t {
+        if (size == 0 || pos == encoded.size()) return 0;
+        *data = encoded[pos++];
+        return 1;
+    };
+    CHECK(easypb::decode_from_source<test::Shape>(trickle, 16) == shape);
+
+    std::istringstream input(encoded + encoded);
+    CHECK(easypb::decode_from_source<test::Shape>(easypb::stream_source(input), 1).labels == shape.labels);
+
+    // The buffer grows only to hold the longest top-level field
+    easypb::SourceBuffer buffer(easypb::stream_source(input), 16);
+    input.clear();
+    input.seekg(0);
+    test::Shape decoded;
+    decode(easypb::Decoder(buffer), decoded);
+    CHECK(decoded.name == shape.name);
+    CHECK(buffer.buffer.size() < encoded.size());
+
+    std::istringstream truncated(encoded.substr(0, encoded.size() - 1));
+    bool eof = false;
+    try {
+        easypb::decode_from_source<test::Shape>(easypb::stream_source(truncated));
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+
+void test_trusted_decoder()
+{
+    const test::Shape shape = make_shape();
+    const std::string encoded = easypb::encode(shape);
+
+    // Hand-written decoders accept TrustedDecoder by converting it into the checked one
+    test::Shape decoded;
+    decode(easypb::TrustedDecoder(encoded), decoded);
+    CHECK(decoded == shape);
+
+    std::vector<int64_t> ids;
+    easypb::TrustedDecoder fields(encoded);
+    while (fields.get_next_field()) {
+        if (fields.field_num == 3)  fields.get_repeated_int64(&ids);  else fields.skip_field();
+    }
+    CHECK(ids == shape.ids);
+
+    // Long varints at the end of the buffer are read bytewise
+    easypb::Encoder pb;
+    pb.write_varint(UINT64_MAX);
+    pb.write_varint(300);
+    pb.write_varint(uint64_t(1) << 40);
+    const std::string varints = pb.result();
+    easypb::TrustedDecoder decoder(varints);
+    CHECK(decoder.read_varint() == UINT64_MAX);
+    CHECK(decoder.read_varint() == 300);
+    CHECK(decoder.read_varint() == uint64_t(1) << 40);
+    CHECK(decoder.eof());
+
+    // Lengths of the length-delimited fields are still checked
+    const std::string truncated("\x0a\x05" "abc", 5);
+    easypb::TrustedDecoder field_decoder(truncated);
+    bool eof = false;
+    try {
+        field_decoder.get_next_field();
+        field_decoder.get_string();
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+
+void test_table_decoder()
+{
+    test::Sample sample;
+    sample.id = -7;
+    sample.weight = 2.5;
+    sample.flag = true;
+    sample.delta = INT64_MIN;
+    sample.text = "text";
+    sample.origin.x = 3;
+    sample.values = {1, 300, UINT64_MAX};
+    sample.labels[5] = "five";
+    sample.level = test::Level::HIGH;
+
+    // Fields in the table order, as written by the generated encoder
+    easypb::Encoder pb;
+    pb.put_int32(1, sample.id);
+    pb.put_double(2, sample.weight);
+    pb.put_bool(3, sample.flag);
+    pb.put_sint64(4, sample.delta);
+    pb.put_string(5, sample.text);
+    pb.put_message(6, sample.origin);
+    pb.put_packed_uint64(7, sample.values);
+    pb.put_map_uint32_string(8, sample.labels);
+    pb.put_int32(9, int32_t(sample.level));
+    pb.put_uint32(100, 42);
+    pb.put_string(101, std::string("skipped"));
+    const std::string encoded = pb.result();
+
+    for (int trusted = 0; trusted < 2; trusted++) {
+        test::Sample decoded;
+        easypb::DecodeStatus status = (trusted? decode(easypb::TrustedDecoder(encoded), decoded)
+                                              : decode(easypb::Decoder(encoded), decoded));
+        CHECK(status == easypb::DECODE_OK);
+        CHECK(decoded.id == -7 && decoded.has_id && decoded.weight == 2.5 && decoded.flag);
+        CHECK(decoded.delta == INT64_MIN && decoded.text == "text");
+        CHECK(decoded.origin == sample.origin && decoded.has_origin);
+        CHECK(decoded.values == sample.values && decoded.labels == sample.labels);
+        CHECK(decoded.level == test::Level::HIGH && decoded.extra == 42);
+    }
+
+    // Fields out of the table order, interleaved with unknown fields, unpacked repeated values,
+    // and the wire types other than used by our Encoder
+    easypb::Encoder shuffled;
+    shuffled.put_repeated_uint64(7, std::vector<uint64_t>{1, 300});
+    shuffled.put_uint32(100, 42);
+    shuffled.put_uint64(7, UINT64_MAX);
+    shuffled.put_fixed32(1, uint32_t(-7));
+    shuffled.put_float(2, 2.5f);
+    shuffled.put_string(5, std::string("text"));
+    shuffled.put_uint32(99, 0);
+    shuffled.put_sint64(4, INT64_MIN);
+    shuffled.put_fixed32(9, uint32_t(test::Level::HIGH));
+    test::Sample decoded;
+    CHECK(decode(easypb::Decoder(shuffled.result()), decoded) == easypb::DECODE_OK);
+    CHECK(decoded.values == sample.values && decoded.extra == 42);
+    CHECK(decoded.id == -7 && decoded.has_id && decoded.weight == 2.5 && decoded.text == "text");
+    CHECK(decoded.delta == INT64_MIN && decoded.level == test::Level::HIGH && ! decoded.has_origin);
+
+    // Malformed input is reported as usual
+    const char* malformed[] = {"\x2a\x05" "abc", "\x0a\x00", "\x32\x02" "\x08\x80", "\xa0\x06\x80"};
+    const size_t sizes[] = {5, 2, 4, 3};
+    for (size_t i = 0; i < 4; i++) {
+        bool error = false;
+        try {
+            test::Sample result;
+            decode(easypb::Decoder(malformed[i], sizes[i]), result);
+        } catch (const easypb::exception&) {
+            error = true;
+        }
+        CHECK(error);
+    }
+}
+
+void test_prescan_fields()
+{
+    test::Shape shape = make_shape();
+    for (int32_t i = 0; i < 300; ++i) {
+        test::Point point;
+        point.x = i;
+        shape.points.push_back(point);
+    }
+    easypb::Encoder pb;
+    encode(pb, shape);
+    pb.put_repeated_int64(3, std::vector<int64_t>{5, -5});  // unpacked
+    pb.put_fixed32(100, 1);
+    pb.put_fixed64(101, 2);
+    const std::string encoded = pb.result();
+
+    // Each tag is counted separately, so packed chunks of field 3 aren't mixed with its unpacked values
+    static constexpr uint32_t tags[] = {
+        easypb::field_tag(2, easypb::WIRETYPE_LENGTH_DELIMITED),
+        easypb::field_tag(3, easypb::WIRETYPE_VARINT),
+        easypb::field_tag(3, easypb::WIRETYPE_LENGTH_DELIMITED),
+        easypb::field_tag(4, easypb::WIRETYPE_LENGTH_DELIMITED),
+        easypb::field_tag(5, easypb::WIRETYPE_LENGTH_DELIMITED),
+    };
+    size_t counts[5];
+    easypb::Decoder decoder(encoded);
+    decoder.count_fields(tags, counts);
+    CHECK(counts[0] == 303 && counts[1] == 2 && counts[2] == 1 && counts[3] == 2 && counts[4] == 0);
+
+    // The decoder state isn't changed, so the counts can be used to reserve space prior to decoding
+    test::Shape decoded;
+    decoded.points.reserve(counts[0]);
+    decode(decoder, decoded);
+    CHECK(decoded.points.size() == 303 && decoded.points.capacity() == 303);
+    CHECK(decoded.points == shape.points && decoded.ids.size() == 5);
+
+    // Short messages aren't prescanned
+    const std::string point = easypb::encode(shape.points[0]);
+    easypb::Decoder(point).prescan_fields(tags, counts);
+    CHECK(counts[0] == 0 && counts[3] == 0);
+    easypb::Decoder(encoded).prescan_fields(tags, counts);
+    CHECK(counts[0] == 303);
+
+    // Counting stops at malformed data: truncated fields, unsupported wire types and too long varints
+    easypb::Decoder(encoded.data(), 10).count_fields(tags, counts);
+    CHECK(counts[0] == 0 && counts[4] == 0);
+    static constexpr uint32_t point_tags[] = {easypb::field_tag(2, easypb::WIRETYPE_LENGTH_DELIMITED)};
+    size_t point_count[1];
+    const std::string malformed[] = {std::string("\x12\x00\x0a\x05" "abc\x12\x00", 9), std::string("\x12\x00\x13\x12\x00", 5),
+                                     std::string("\x12\x00\x18\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\x12\x00", 16),
+                                     std::string("\x12\x00\x18", 3)};
+    for (const std::string& data: malformed) {
+        easypb::Decoder(data).count_fields(point_tags, point_count);
+        CHECK(point_count[0] == 1);
+    }
+}
+
+// Container without emplace_back(), getting copies of decoded messages
+struct PointList
+{
+    typedef test::Point value_type;
+    std::vector<test::Point> points;
+
+    void push_back(const test::Point& point)  {points.push_back(point);}
+};
+
+void test_repeated_messages()
+{
+    std::vector<test::Point> points(5);
+    for (int32_t i = 0; i < 5; ++i) {
+        points[i].x = i;
+        points[i].y = -i;
+    }
+    const std::vector<std::string> strings = {"one", "two", std::string(100, '3')};
+    easypb::Encoder pb;
+    pb.put_repeated_message(1, points);
+    pb.put_repeated_string(2, strings);
+    const std::string encoded = pb.result();
+
+    // Messages are decoded into new elements of any container
+    std::list<test::Point> point_list;
+    PointList point_copies;
+    easypb::Decoder decoder(encoded);
+    while (decoder.get_next_field()) {
+        if (decoder.field_num == 1) {
+            easypb::Decoder copy = decoder;
+            decoder.get_repeated_message(&point_list);
+            copy.get_repeated_message(&point_copies);
+        } else {
+            decoder.skip_field();
+        }
+    }
+    CHECK(point_list == std::list<test::Point>(points.begin(), points.end()));
+    CHECK(point_copies.points == points);
+
+    // Decoding over the existing elements, as generated by codegen --reuse-storage.
+    // The extra elements are erased, and the missing ones are appended
+    for (size_t old_size: {0, 3, 5, 8}) {
+        std::vector<test::Point> reused_points(old_size);
+        std::vector<std::string> reused_strings(old_size, std::string(200, 'x'));
+        const char* first_string = (old_size? reused_strings[0].data() : nullptr);
+        size_t points_count = 0, strings_count = 0;
+        easypb::Decoder reuse_decoder(encoded);
+        while (reuse_decoder.get_next_field()) {
+            switch (reuse_decoder.field_num) {
+                case 1: reuse_decoder.get_repeated_message(&reused_points, &points_count); break;
+                case 2: reuse_decoder.get_repeated_string(&reused_strings, &strings_count); break;
+                default: reuse_decoder.skip_field();
+            }
+        }
+        easypb::truncate(reused_points, points_count);
+        easypb::truncate(reused_strings, strings_count);
+        CHECK(reused_points == points && reused_strings == strings);
+        CHECK(! first_string || reused_strings[0].data() == first_string);
+    }
+
+    std::list<int> numbers = {1, 2, 3};
+    easypb::truncate(numbers, 1);
+    CHECK(numbers == std::list<int>{1});
+    std::string text = "text";
+    int number = 5;
+    test::Point point;
+    point.x = 1;
+    easypb::clear_value(text);
+    easypb::clear_value(number);
+    easypb::clear_value(point);
+    CHECK(text.empty() && text.capacity() > 0 && number == 0 && point.x == 0);
+}
+
+void test_merged_submessages()
+{
+    test::Frame first, second;
+    first.id = 1;
+    first.has_id = first.has_outline = second.has_outline = true;
+    first.outline.name = "first";
+    first.outline.has_name = true;
+    first.outline.points.resize(2);
+    first.outline.points[1].x = 10;
+    second.outline.points.resize(1);
+    second.outline.points[0].y = 20;
+
+    // The second occurrence of the submessage is merged into the first one, appending the repeated field.
+    // The reused message is reset only on the first occurrence
+    std::string encoded = easypb::encode(first) + easypb::encode(second);
+    test::Frame frame;
+    frame.outline.name = "stale";
+    frame.outline.points.resize(5);
+    easypb::decode(encoded, &frame);
+    CHECK(frame.id == 1 && frame.has_outline && frame.outline.name == "first" && frame.outline.has_name);
+    CHECK(frame.outline.points.size() == 3 && frame.outline.points[1].x == 10 && frame.outline.points[2].y == 20);
+
+    // Decoding anew resets the reused message
+    easypb::decode(easypb::encode(second), &frame);
+    CHECK(frame.id == 0 && frame.outline.name.empty() && ! frame.outline.has_name);
+    CHECK(frame.outline.points.size() == 1 && frame.outline.points[0].y == 20);
+
+    easypb::decode(std::string(), &frame);
+    CHECK(! frame.has_outline && frame.outline.points.empty());
+}
+
+void test_map_fields()
+{
+    std::map<std::string, std::string> entries;
+    for (int i = 0; i < 300; ++i) {
+        entries["key" + std::to_string(i)] = std::string(50, char('a' + i % 26));
+    }
+    easypb::Encoder pb;
+    pb.put_map_string_string(1, entries);
+    pb.put_map_string_string(1, std::map<std::string, std::string>{{"key7", "last"}});  // duplicate key
+    const std::string encoded = pb.result();
+
+    // Buckets of hash tables are reserved from the prescan, as generated by codegen --prescan-repeated
+    static constexpr uint32_t tags[] = {easypb::field_tag(1, easypb::WIRETYPE_LENGTH_DELIMITED)};
+    size_t counts[1];
+    easypb::Decoder decoder(encoded);
+    decoder.prescan_fields(tags, counts);
+    CHECK(counts[0] == 301);
+    std::unordered_map<std::string, std::string> hash_map;
+    easypb::reserve_space(hash_map, counts[0]);
+    const size_t bucket_count = hash_map.bucket_count();
+    CHECK(bucket_count * hash_map.max_load_factor() >= 301);
+
+    // The last value of a duplicate key wins
+    while (decoder.get_next_field()) {
+        decoder.get_map_string_string(&hash_map);
+    }
+    entries["key7"] = "last";
+    CHECK(hash_map.size() == 300 && hash_map.bucket_count() == bucket_count);
+    CHECK((std::map<std::string, std::string>(hash_map.begin(), hash_map.end()) == entries));
+
+    std::map<std::string, std::string> tree_map;
+    easypb::reserve_space(tree_map, 300);
+    easypb::Decoder tree_decoder(encoded);
+    while (tree_decoder.get_next_field()) {
+        tree_decoder.get_map_string_string(&tree_map);
+    }
+    CHECK(tree_map == entries);
+}
+
+void test_arena()
+{
+    easypb::Arena arena;
+    char* small = static_cast<char*>(arena.allocate(3, 1));
+    int64_t* aligned = static_cast<int64_t*>(arena.allocate(sizeof(int64_t), alignof(int64_t)));
+    void* large = arena.allocate(easypb::Arena::MAX_BLOCK_SIZE);
+    void* next = arena.allocate(10, 1);
+    CHECK(reinterpret_cast<uintptr_t>(aligned) % alignof(int64_t) == 0);
+    CHECK(next == small + 3 + 5 + sizeof(int64_t));  // large allocation got its own block
+    CHECK(large != nullptr && arena.block_count() == 2 && arena.used_bytes() == 3 + 8 + easypb::Arena::MAX_BLOCK_SIZE + 10);
+
+    // reset() makes the blocks available for the same sequence of allocations
+    size_t allocated = arena.allocated_bytes();
+    arena.reset();
+    CHECK(arena.allocate(3, 1) == small && arena.used_bytes() == 3);
+    arena.allocate(easypb::Arena::MAX_BLOCK_SIZE);
+    CHECK(arena.allocated_bytes() == allocated && arena.block_count() == 2);
+
+    // The Decoder copies strings into the arena and allocates ArenaVector elements there,
+    // including the containers of nested messages
+    std::vector<test::Point> points(100);
+    for (int32_t i = 0; i < 100; ++i)  points[i].x = i;
+    easypb::Encoder pb;
+    pb.put_string(1, std::string("arena string"));
+    pb.put_repeated_message(2, points);
+    std::string encoded = pb.result();
+
+    easypb::Arena decoding_arena;
+    easypb::ArenaVector<test::Point> decoded_points;
+    easypb::attach_arena(decoded_points, &decoding_arena);
+    easypb::string_view text("", 0);
+    easypb::Decoder decoder(encoded);
+    decoder.arena = &decoding_arena;
+    while (decoder.get_next_field()) {
+        switch (decoder.field_num) {
+            case 1: text = decoder.get_string(); break;
+            case 2: decoder.get_repeated_message(&decoded_points); break;
+            default: decoder.skip_field();
+        }
+    }
+    std::fill(encoded.begin(), encoded.end(), '\0');  // the string stays intact in the arena
+    CHECK(std::string(text.data(), text.size()) == "arena string");
+    CHECK(std::vector<test::Point>(decoded_points.begin(), decoded_points.end()) == points);
+    CHECK(decoded_points.get_allocator().arena == &decoding_arena);
+    CHECK(decoding_arena.used_bytes() >= 12 + 100 * sizeof(test::Point));
+
+    // Attaching other arena moves the elements, and containers without ArenaAllocator are left intact
+    easypb::Arena other_arena;
+    easypb::attach_arena(decoded_points, &other_arena);
+    CHECK(decoded_points.get_allocator().arena == &other_arena && decoded_points.size() == 100 && decoded_points[99].x == 99);
+    easypb::attach_arena(points, &other_arena);
+    CHECK(points.size() == 100);
+
+    // Copies of the containers, including the nested ones, are made on the heap and outlive the arena
+    using Nested = easypb::ArenaVector<easypb::ArenaVector<int32_t>>;
+    Nested copied, assigned;
+    {
+        easypb::Arena scoped_arena;
+        Nested original;
+        easypb::attach_arena(original, &scoped_arena);
+        for (int32_t i = 0; i < 10; ++i) {
+            original.emplace_back(easypb::ArenaVector<int32_t>(100, i, easypb::ArenaAllocator<int32_t>(&scoped_arena)));
+        }
+        copied = Nested(original);
+        assigned = original;
+        CHECK(copied.get_allocator().arena == nullptr && copied[9].get_allocator().arena == nullptr);
+        CHECK(assigned.get_allocator().arena == nullptr && assigned[9].get_allocator().arena == nullptr);
+    }
+    for (const Nested* nested: {&copied, &assigned}) {
+        CHECK(nested->size() == 10 && (*nested)[9].size() == 100 && (*nested)[9][99] == 9);
+    }
+}
+
+// Message with lazily decoded submessages, in the form produced by Codegen --lazy
+struct Envelope
+{
+    uint32_t id = 0;
+    easypb::Lazy<test::Shape> shape;
+    std::vector<easypb::Lazy<test::Point>> points;
+};
+
+template <typename Writer>
+void encode(Writer& pb, const Envelope& x)
+{
+    pb.put_uint32(1, x.id);
+    pb.put_message(2, x.shape);
+    pb.put_repeated_message(3, x.points);
+}
+
+void decode(easypb::Decoder pb, Envelope& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_uint32(&x.id); break;
+            case 2: pb.get_message(&x.shape); break;
+            case 3: pb.get_repeated_message(&x.points); break;
+            default: pb.skip_field();
+        }
+    }
+}
+
+void test_lazy_messages()
+{
+    const test::Shape shape = make_shape();
+    Envelope envelope;
+    envelope.id = 1;
+    envelope.shape = shape;
+    for (int32_t i = 0; i < 3; ++i) {
+        test::Point point;
+        point.x = i;
+        envelope.points.push_back(point);
+    }
+    CHECK(! envelope.shape.has_encoded() && envelope.shape->name == shape.name);
+    const std::string encoded = easypb::encode_compact(envelope);
+
+    // Submessages are kept encoded and written back as is, even after reading them
+    std::string buffer = encoded;
+    Envelope decoded = easypb::decode<Envelope>(buffer);
+    CHECK(decoded.id == 1 && ! decoded.shape.is_decoded() && decoded.shape.has_encoded());
+    CHECK(easypb::encode_compact(decoded) == encoded && easypb::encoded_size(decoded) == encoded.size());
+    CHECK(*decoded.shape == shape && decoded.points.size() == 3 && decoded.points[2]->x == 2);
+    CHECK(decoded.shape.is_decoded() && easypb::encode_compact(decoded) == encoded);
+
+    // Modified submessages are encoded anew
+    decoded.points[1].mutable_get().y = 100;
+    const std::string modified = easypb::encode_compact(decoded);
+    CHECK(modified != encoded && ! decoded.points[1].has_encoded() && decoded.points[0].has_encoded());
+    CHECK(easypb::decode<Envelope>(modified).points[1]->y == 100);
+
+    // The next occurrences of the submessage are merged into the decoded one
+    easypb::Encoder pb;
+    pb.put_message(2, shape);
+    pb.put_message(2, shape);
+    Envelope merged = easypb::decode<Envelope>(pb.result());
+    CHECK(merged.shape.is_decoded() && ! merged.shape.has_encoded() && merged.shape->points.size() == 2 * shape.points.size());
+    merged.shape.clear();
+    CHECK(merged.shape.empty() && merged.shape->points.empty());
+
+    // Malformed submessages are reported on every access, and stay encoded
+    const std::string malformed_data("\x08\x00\x12\x02\x0a\x05", 6);
+    Envelope malformed = easypb::decode<Envelope>(malformed_data);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool eof = false;
+        try {
+            malformed.shape.get();
+        } catch (const easypb::unexpected_eof&) {
+            eof = true;
+        }
+        CHECK(eof && ! malformed.shape.is_decoded() && malformed.shape.has_encoded());
+    }
+    CHECK(easypb::encode_compact(malformed) == malformed_data);
+
+    // With the arena, the encoded submessages are copied, so the input buffer may be freed
+    easypb::Arena arena;
+    Envelope arena_decoded;
+    easypb::decode(buffer, &arena_decoded, arena);
+    std::fill(buffer.begin(), buffer.end(), '\0');
+    CHECK(*arena_decoded.shape == shape && easypb::encode_compact(arena_decoded) == encoded);
+
+    // Without an arena, the streaming Decoder copies the submessages out of the buffer refilled by the next fields
+    std::istringstream input(encoded);
+    Envelope streamed = easypb::decode_from_source<Envelope>(easypb::stream_source(input), 16);
+    const Envelope copied = streamed;
+    streamed = Envelope();
+    CHECK(copied.shape.has_encoded() && copied.points[0].has_encoded());
+    CHECK(*copied.shape == shape && copied.points[2]->x == 2 && easypb::encode_compact(copied) == encoded);
+}
+
+void test_padded_input()
+{
+    // A sub-decoder reads varints up to its end by the fast path, using the rest of the enclosing message as slop
+    test::Shape shape;
+    shape.points.resize(1);
+    shape.points[0].x = INT32_MIN;
+    shape.points[0].y = INT32_MAX;
+    shape.name = "after";
+    const std::string encoded = easypb::encode(shape);
+    CHECK(easypb::decode<test::Shape>(encoded) == shape);
+
+    // Malformed fields overrunning their message into the slop: an unterminated varint in a sub-message,
+    // in a packed field, and at the end of a padded buffer
+    const char* malformed[] = {"\x12\x02" "\x08\x80" "\x0a\x08" "abcdefgh",
+                               "\x1a\x01" "\x80" "\x0a\x08" "abcdefgh"};
+    for (const char* data: malformed) {
+        bool eof = false;
+        try {
+            easypb::decode<test::Shape>(easypb::string_view(data, 14));
+        } catch (const easypb::unexpected_eof&) {
+            eof = true;
+        }
+        CHECK(eof);
+    }
+
+    const char padded[16] = "\x08\x80\x01";
+    easypb::Decoder pb(padded, 2, sizeof(padded) - 2);
+    bool eof = false;
+    try {
+        while (pb.get_next_field())  pb.get_int32();
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+
+void test_record_stream()
+{
+    test::Shape shapes[3] = {make_shape(), test::Shape(), make_shape()};
+    shapes[2].name = "square";
+
+    easypb::RecordWriter writer(easypb::Encoder(), true);
+    for (const auto& shape: shapes) {
+        writer.write(shape);
+    }
+    const std::string stream = writer.pb.result();
+
+    // Each record is a varint length followed by the compact encoding of the message
+    const std::string first = easypb::encode_compact(shapes[0]);
+    CHECK(first.size() > 127 && first.size() < 16384);
+    CHECK(uint8_t(stream[0]) == (first.size() & 127) + 128);
+    CHECK(uint8_t(stream[1]) == first.size() >> 7);
+    CHECK(stream.substr(2, first.size()) == first);
+
+    easypb::RecordReader reader(stream);
+    test::Shape decoded;
+    for (const auto& shape: shapes) {
+        CHECK(reader.next_message(&decoded) && decoded == shape);
+    }
+    CHECK(! reader.next_message(&decoded));
+
+    // Side index gives random access to the records
+    CHECK(writer.offsets.size() == 3);
+    CHECK(easypb::index_records(stream) == writer.offsets);
+    CHECK(easypb::decode<test::Shape>(easypb::record_at(stream, writer.offsets[2])) == shapes[2]);
+    CHECK(std::string(easypb::record_at(stream, writer.offsets[1])) == easypb::encode_compact(shapes[1]));
+
+    // Records split between chunks of the streaming source
+    std::istringstream input(stream);
+    easypb::SourceBuffer buffer(easypb::stream_source(input), 16);
+    easypb::RecordReader stream_reader(buffer);
+    size_t records = 0;
+    while (stream_reader.next_message(&decoded)) {
+        CHECK(decoded == shapes[records++]);
+    }
+    CHECK(records == 3);
+}
+
+#ifdef EASYPB_PARALLEL
+void test_parallel_decode()
+{
+    easypb::RecordWriter writer;
+    std::vector<test::Shape> shapes;
+    for (int i = 0; i < 100; ++i) {
+        test::Shape shape = make_shape();
+        shape.name = std::to_string(i);
+        shape.points.resize(i % 7);
+        writer.write(shape);
+        shapes.push_back(shape);
+    }
+    const std::string stream = writer.pb.result();
+
+    for (unsigned threads: {0u, 1u, 3u, 1000u}) {
+        CHECK(easypb::decode_records_parallel<test::Shape>(stream, threads) == shapes);
+    }
+    CHECK(easypb::decode_records_parallel<test::Shape>(std::string()).empty());
+
+    // An error in any thread is rethrown after all threads are finished
+    bool eof = false;
+    try {
+        easypb::decode_records_parallel<test::Shape>(stream.substr(0, stream.size() - 1), 4);
+    } catch (const easypb::unexpected_eof&) {
+        eof = true;
+    }
+    CHECK(eof);
+}
+#endif
+
+} // namespace
+
+int main()
+{
+    try {
+        test_varint_size();
+        test_read_varint();
+        test_packed_varints();
+        test_packed_zigzag();
+        test_packed_fixed();
+        test_compact_encoding();
+        test_external_memory();
+        test_constant_field_tags();
+        test_reserved_fields();
+        test_encoder_reuse();
+        test_streaming();
+        test_segmented();
+        test_streaming_decoder();
+        test_trusted_decoder();
+        test_padded_input();
+        test_table_decoder();
+        test_prescan_fields();
+        test_repeated_messages();
+        test_merged_submessages();
+        test_map_fields();
+        test_arena();
+        test_lazy_messages();
+        test_record_stream();
+#ifdef EASYPB_PARALLEL
+        test_parallel_decode();
+#endif
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (failures != 0) {
+        std::cerr << failures << " test(s) failed\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "all library tests passed\n";
+    return EXIT_SUCCESS;
+}
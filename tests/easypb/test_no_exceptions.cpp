@@ -0,0 +1,220 @@
+// Decoding of malformed input in the EASYPB_NO_EXCEPTIONS mode.
+// It's a separate program, since the mode can't be mixed with the default one in a single program
+#define EASYPB_NO_EXCEPTIONS
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <easypb.hpp>
+
+namespace test {
+
+struct Point
+{
+    int32_t x = 0;
+    bool has_x = false;
+    std::vector<int32_t> tags;
+};
+
+struct Shape
+{
+    std::string name;
+    std::vector<Point> points;
+    std::vector<uint64_t> ids;
+    std::vector<double> weights;
+    std::map<uint32_t, std::string> labels;
+};
+
+template <typename Writer>
+void encode(Writer& pb, const Point& x)
+{
+    pb.put_sint32(1, x.x);
+    pb.put_packed_int32(2, x.tags);
+}
+
+template <typename Writer>
+void encode(Writer& pb, const Shape& x)
+{
+    pb.put_string(1, x.name);
+    pb.put_repeated_message(2, x.points);
+    pb.put_packed_uint64(3, x.ids);
+    pb.put_packed_double(4, x.weights);
+    pb.put_map_uint32_string(5, x.labels);
+}
+
+// Decoders in the form produced by Codegen
+inline easypb::DecodeStatus decode(easypb::Decoder pb, Point& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_sint32(&x.x, &x.has_x); break;
+            case 2: pb.get_repeated_int32(&x.tags); break;
+            default: pb.skip_field();
+        }
+    }
+
+    if (! x.has_x) {
+        return pb.missing_field("Point.x");
+    }
+
+    return pb.status;
+}
+
+inline easypb::DecodeStatus decode(easypb::Decoder pb, Shape& x)
+{
+    while (pb.get_next_field()) {
+        switch (pb.field_num) {
+            case 1: pb.get_string(&x.name); break;
+            case 2: pb.get_repeated_message(&x.points); break;
+            case 3: pb.get_repeated_uint64(&x.ids); break;
+            case 4: pb.get_repeated_double(&x.weights); break;
+            case 5: pb.get_map_uint32_string(&x.labels); break;
+            default: pb.skip_field();
+        }
+    }
+    return pb.status;
+}
+
+} // namespace test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* expression, const char* file, int line)
+{
+    if (!condition) {
+        std::cerr << file << ':' << line << ": CHECK failed: " << expression << '\n';
+        ++failures;
+    }
+}
+
+#define CHECK(x) check((x), #x, __FILE__, __LINE__)
+
+easypb::DecodeStatus decode_shape(const std::string& data)
+{
+    test::Shape shape;
+    return easypb::decode(data, &shape);
+}
+
+void test_valid_input()
+{
+    test::Point point;
+    point.x = -5;
+    point.tags.push_back(300);
+    easypb::Encoder pb;
+    pb.put_string(1, std::string("square"));
+    pb.put_message(2, point);
+    pb.put_packed_uint64(3, std::vector<uint64_t>{1, 300, UINT64_MAX});
+    pb.put_packed_double(4, std::vector<double>{0.5});
+    pb.put_map_uint32_string(5, std::map<uint32_t, std::string>{{7, "seven"}});
+
+    test::Shape shape;
+    CHECK(easypb::decode(pb.result(), &shape) == easypb::DECODE_OK);
+    CHECK(shape.name == "square");
+    CHECK(shape.points.size() == 1 && shape.points[0].x == -5 && shape.points[0].tags.size() == 1);
+    CHECK(shape.ids.size() == 3 && shape.ids[2] == UINT64_MAX);
+    CHECK(shape.weights.size() == 1 && shape.labels[7] == "seven");
+}
+
+void test_malformed_input()
+{
+    using namespace easypb;
+
+    // Truncated varints: in the tag, in the value and in the length
+    CHECK(decode_shape(std::string("\x88", 1)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x18\xff\xff", 3)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x0a\x85", 2)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x18" "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 12)) == DECODE_VARINT_TOO_LONG);
+
+    // Field contents beyond the end of buffer
+    CHECK(decode_shape(std::string("\x0a\x05" "abc", 5)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x21" "\x00\x00\x00", 4)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x0a\xff\xff\xff\xff\x0f", 6)) == DECODE_LENGTH_TOO_LONG);
+
+    // Wire types and field tags
+    CHECK(decode_shape(std::string("\x4b", 1)) == DECODE_UNSUPPORTED_WIRETYPE);
+    CHECK(decode_shape(std::string("\x08\x01", 2)) == DECODE_WIRETYPE_MISMATCH);
+    CHECK(decode_shape(std::string("\x80\x80\x80\x80\x80\x01", 6)) == DECODE_INVALID_FIELDNUM);
+
+    // Errors in the packed fields: the last varint is unterminated, and a partial double
+    test::Shape shape;
+    CHECK(decode(std::string("\x1a\x0b" "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x80", 13), &shape) == DECODE_UNEXPECTED_EOF);
+    CHECK(shape.ids.size() <= 11);
+    CHECK(decode_shape(std::string("\x22\x03" "\x00\x00\x00", 5)) == DECODE_UNEXPECTED_EOF);
+
+    // Errors in the nested messages: a missing required field, a truncated packed field and a truncated map entry
+    CHECK(decode_shape(std::string("\x12\x00", 2)) == DECODE_MISSING_REQUIRED_FIELD);
+    CHECK(decode_shape(std::string("\x12\x04" "\x08\x01\x12\x81", 6)) == DECODE_UNEXPECTED_EOF);
+    CHECK(decode_shape(std::string("\x2a\x02" "\x08\x87", 4)) == DECODE_UNEXPECTED_EOF);
+
+    // The first error is kept, and the decoding stops after it
+    std::string data("\x18\x01", 2);
+    Decoder pb(data);
+    pb.fail(DECODE_LENGTH_TOO_LONG);
+    CHECK(! pb.get_next_field());
+    CHECK(pb.read_varint() == 0 && pb.status == DECODE_LENGTH_TOO_LONG);
+    CHECK(std::string(status_message(pb.status)) == "Length-delimited field is too long");
+}
+
+void test_lazy_message()
+{
+    // A truncated submessage is reported without decoding it partially, and written back as is
+    std::string data("\x12\x02" "\x0a\x05", 4);
+    easypb::Lazy<test::Shape> shape;
+    shape.set_encoded(data.substr(2));
+    CHECK(shape.get().name.empty() && ! shape.is_decoded());
+    CHECK(shape.decode_status() == easypb::DECODE_UNEXPECTED_EOF);
+    CHECK(shape.get().name.empty() && shape.decode_status() == easypb::DECODE_UNEXPECTED_EOF);
+
+    easypb::Encoder pb;
+    encode(pb, shape);
+    CHECK(pb.result() == data.substr(2));
+}
+
+void test_record_stream()
+{
+    easypb::Encoder encoder;
+    easypb::RecordWriter writer(std::move(encoder));
+    test::Shape shape;
+    shape.name = "first";
+    writer.write(shape);
+    writer.write(shape);
+    std::string data = writer.pb.result() + std::string("\x05" "ab", 3);
+
+    easypb::DecodeStatus status = easypb::DECODE_OK;
+    CHECK(easypb::index_records(data, &status).size() == 2);
+    CHECK(status == easypb::DECODE_UNEXPECTED_EOF);
+#ifdef EASYPB_PARALLEL
+    CHECK(easypb::decode_records_parallel<test::Shape>(data, 2, &status).size() == 2);
+    CHECK(status == easypb::DECODE_UNEXPECTED_EOF);
+#endif
+    CHECK(easypb::record_at(data, data.size(), &status).size() == 0);
+    CHECK(status == easypb::DECODE_UNEXPECTED_EOF);
+
+    easypb::RecordReader reader(data);
+    size_t records = 0;
+    while (reader.next_message(&shape))  records++;
+    CHECK(records == 2 && shape.name == "first");
+    CHECK(reader.pb.status == easypb::DECODE_UNEXPECTED_EOF);
+}
+
+}  // namespace
+
+int main()
+{
+    test_valid_input();
+    test_malformed_input();
+    test_lazy_message();
+    test_record_stream();
+
+    if (failures != 0) {
+        std::cerr << failures << " test(s) failed\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "all no-exceptions tests passed\n";
+    return EXIT_SUCCESS;
+}
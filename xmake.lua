@@ -17,6 +17,29 @@ target("tutorial")
     set_kind("binary")
     add_files("examples/tutorial/main.cpp")
 
+target("benchmark_parallel_decode")
+    set_kind("binary")
+    add_files("examples/benchmarks/parallel_decode.cpp")
+    if is_plat("linux", "bsd") then
+        add_syslinks("pthread")
+    end
+
+target("benchmark_varint_decode")
+    set_kind("binary")
+    add_files("examples/benchmarks/varint_decode.cpp")
+
+target("benchmark_field_types")
+    set_kind("binary")
+    add_files("examples/benchmarks/field_types.cpp")
+
+target("benchmark_encode")
+    set_kind("binary")
+    add_files("examples/benchmarks/encode.cpp")
+
+target("benchmark_decode")
+    set_kind("binary")
+    add_files("examples/benchmarks/decode.cpp")
+
 if has_config("codegen_parser") then
     target("easypb_proto_parser")
         set_kind("static")